@@ -0,0 +1,249 @@
+/*
+	BATCHLOOKUP.CPP
+	---------------
+	indexReference
+
+	Look up (and verify against the genome) k-mers in a deserialised index, either one at a time or many at once with their
+	memory accesses interleaved (asynchronous memory access chaining, AMAC) so that several cache misses are in flight at once.
+*/
+#include "hash.hpp"
+#include "batchLookup.hpp"
+#include "encode_kmer_2bit.h"
+
+/*
+	VERIFY()
+	--------
+	The bucket only tells us the hash matched (after MASK), so check the genome really has the k-mer (or its reverse
+	complement) at position.  Returns 0 for no, 1 for the k-mer, 2 for its reverse complement.
+*/
+static inline int verify(const index_view &index, uint32_t position, uint64_t kmer, uint64_t reverse)
+	{
+	if (position + 32ULL > index.genome_size)
+		return 0;
+
+	uint64_t found = encode_kmer_2bit::pack_32mer(index.genome + position);
+	return found == kmer ? 1 : found == reverse ? 2 : 0;
+	}
+
+/*
+	REJECTED()
+	----------
+	True if the index's prefilter says the canonical k-mer is not in the genome, so there is no need to read its bucket.
+*/
+static inline bool rejected(const index_view &index, uint64_t canonical)
+	{
+	return index.prefilter != nullptr && !index.prefilter->possibly_contains(canonical);
+	}
+
+/*
+	REPEAT_POSITIONS()
+	------------------
+	An empty bucket might have been moved to the repeat table.  If so, and the table kept its positions, point positions at
+	them and return how many there are.  If the table kept only a count, return 0 and set masked to that count.
+*/
+static inline size_t repeat_positions(const index_view &index, uint64_t bucket, const uint32_t *&positions, uint32_t &masked)
+	{
+	masked = 0;
+	const repeat_bucket *entry = index.repeats == nullptr ? nullptr : index.repeats->find(static_cast<uint32_t>(bucket));
+	if (entry == nullptr)
+		return 0;
+
+	positions = index.repeats->positions.data() + entry->offset;
+	masked = entry->stored == 0 ? entry->count : 0;
+	return entry->stored;
+	}
+
+/*
+	OUTER_ENTRY()
+	-------------
+	Where the OuterBlob entry of bucket is (for prefetching)
+*/
+static inline const uint32_t *outer_entry(const index_view &index, uint64_t bucket)
+	{
+	return index.outer + (index.layout == INLINE_LAYOUT ? 2 * bucket : bucket);
+	}
+
+/*
+	LOOKUP_KMERS_HASHED()
+	---------------------
+*/
+template <typename HASH>
+static void lookup_kmers_hashed(const index_view &index, const uint64_t *kmers, size_t count, std::vector<lookup_hit> &hits)
+	{
+	for (size_t query = 0; query < count; query++)
+		{
+		uint64_t kmer = kmers[query];
+		uint64_t reverse = encode_kmer_2bit::reverse_complement_32mer(kmer);
+		if (rejected(index, kmer ^ reverse))
+			continue;
+		uint64_t bucket = HASH::hash(kmer ^ reverse) & index.MASK;
+		const uint32_t *positions;
+		uint32_t scratch[2];
+		size_t count = bucket_positions(index.inner, index.inner_size, index.outer, index.outer_size, bucket, index.layout, positions, scratch);
+		uint32_t masked;
+		if (count == 0 && (count = repeat_positions(index, bucket, positions, masked)) == 0 && masked != 0)
+			hits.push_back(lookup_hit{static_cast<uint32_t>(query), 0, false, masked});
+
+		for (size_t current = 0; current < count; current++)
+			if (int strand = verify(index, positions[current], kmer, reverse))
+				hits.push_back(lookup_hit{static_cast<uint32_t>(query), positions[current], strand == 2, 0});
+		}
+	}
+
+/*
+	CLASS LOOKUP_STATE
+	------------------
+	One in-flight lookup.  Each stage issues a prefetch for the next stage's data and then yields to the next lookup.
+*/
+class lookup_state
+	{
+	public:
+		enum {IDLE, PREFILTER, OUTER, INNER, VERIFY};
+
+	public:
+		uint32_t stage;
+		uint32_t query;
+		uint64_t kmer;
+		uint64_t reverse;
+		uint64_t bucket;
+		const uint32_t *positions;	// the posting list (in the InnerBlob, or scratch if it was inline)
+		uint32_t scratch[2];
+		uint64_t current;		// where we are in the posting list
+		uint64_t end;			// the length of the posting list
+		uint32_t position;	// the position being verified
+
+	public:
+		lookup_state() :
+			stage(IDLE)
+			{
+			/* Nothing */
+			}
+	};
+
+/*
+	LOOKUP_KMERS_INTERLEAVED_HASHED()
+	---------------------------------
+	Round-robin over in_flight state machines:
+		IDLE      -> start the next query: prefetch its prefilter block (if there is a prefilter), else as PREFILTER
+		PREFILTER -> if the prefilter rejects the query go back to IDLE, otherwise hash it and prefetch its OuterBlob entry
+		OUTER     -> read the bucket's entry and prefetch the start of its posting list (or, if the positions are inline in
+		             the entry, prefetch the genome at the first and go straight to VERIFY).  An empty bucket is looked
+		             for in the repeat table, whose positions are read as if they were in the InnerBlob.
+		INNER     -> read the next position and prefetch the genome at that position
+		VERIFY    -> compare the genome with the k-mer, then on to the next position (through INNER if it is in the InnerBlob)
+		             or back to IDLE
+*/
+template <typename HASH>
+static void lookup_kmers_interleaved_hashed(const index_view &index, const uint64_t *kmers, size_t count, std::vector<lookup_hit> &hits, size_t in_flight)
+	{
+	std::vector<lookup_state> slots(in_flight == 0 ? 1 : in_flight);
+	size_t next = 0;
+	size_t active = 0;
+
+	do
+		for (auto &slot : slots)
+			switch (slot.stage)
+				{
+				case lookup_state::IDLE:
+					if (next >= count)
+						break;
+					slot.query = static_cast<uint32_t>(next);
+					slot.kmer = kmers[next];
+					slot.reverse = encode_kmer_2bit::reverse_complement_32mer(slot.kmer);
+					next++;
+					active++;
+					if (index.prefilter != nullptr)
+						{
+						index.prefilter->prefetch(slot.kmer ^ slot.reverse);
+						slot.stage = lookup_state::PREFILTER;
+						break;
+						}
+					// fall through - with no prefilter to wait for, hash the query now
+
+				case lookup_state::PREFILTER:
+					if (rejected(index, slot.kmer ^ slot.reverse))
+						{
+						slot.stage = lookup_state::IDLE;
+						active--;
+						}
+					else
+						{
+						slot.bucket = HASH::hash(slot.kmer ^ slot.reverse) & index.MASK;
+						__builtin_prefetch(outer_entry(index, slot.bucket));
+						slot.stage = lookup_state::OUTER;
+						}
+					break;
+
+				case lookup_state::OUTER:
+					slot.current = 0;
+					slot.end = bucket_positions(index.inner, index.inner_size, index.outer, index.outer_size, slot.bucket, index.layout, slot.positions, slot.scratch);
+					if (slot.end == 0 && index.repeats != nullptr)
+						{
+						uint32_t masked;
+						if ((slot.end = repeat_positions(index, slot.bucket, slot.positions, masked)) == 0 && masked != 0)
+							hits.push_back(lookup_hit{slot.query, 0, false, masked});
+						}
+					if (slot.end == 0)
+						{
+						slot.stage = lookup_state::IDLE;
+						active--;
+						}
+					else if (slot.positions == slot.scratch)
+						{
+						slot.position = slot.scratch[0];
+						__builtin_prefetch(index.genome + slot.position);
+						__builtin_prefetch(index.genome + slot.position + 31);
+						slot.stage = lookup_state::VERIFY;
+						}
+					else
+						{
+						__builtin_prefetch(slot.positions);
+						slot.stage = lookup_state::INNER;
+						}
+					break;
+
+				case lookup_state::INNER:
+					slot.position = slot.positions[slot.current];
+					__builtin_prefetch(index.genome + slot.position);
+					__builtin_prefetch(index.genome + slot.position + 31);
+					slot.stage = lookup_state::VERIFY;
+					break;
+
+				case lookup_state::VERIFY:
+					if (int strand = verify(index, slot.position, slot.kmer, slot.reverse))
+						hits.push_back(lookup_hit{slot.query, slot.position, strand == 2, 0});
+					if (++slot.current < slot.end && slot.positions == slot.scratch)
+						{
+						slot.position = slot.scratch[slot.current];
+						__builtin_prefetch(index.genome + slot.position);
+						__builtin_prefetch(index.genome + slot.position + 31);
+						}
+					else if (slot.current < slot.end)
+						slot.stage = lookup_state::INNER;
+					else
+						{
+						slot.stage = lookup_state::IDLE;
+						active--;
+						}
+					break;
+				}
+	while (active != 0 || next < count);
+	}
+
+/*
+	LOOKUP_KMERS()
+	--------------
+*/
+void lookup_kmers(const index_view &index, const uint64_t *kmers, size_t count, std::vector<lookup_hit> &hits)
+	{
+	HASH_DISPATCH(index.hash, lookup_kmers_hashed)(index, kmers, count, hits);
+	}
+
+/*
+	LOOKUP_KMERS_INTERLEAVED()
+	--------------------------
+*/
+void lookup_kmers_interleaved(const index_view &index, const uint64_t *kmers, size_t count, std::vector<lookup_hit> &hits, size_t in_flight)
+	{
+	HASH_DISPATCH(index.hash, lookup_kmers_interleaved_hashed)(index, kmers, count, hits, in_flight);
+	}
@@ -0,0 +1,1436 @@
+/*
+	BENCHMARK.CPP
+	-------------
+	indexReference
+
+	Microbenchmarks of the indexer's hot paths over a seeded synthetic genome.  Results are printed and written as JSON.
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <ctime>
+#include <chrono>
+#include <random>
+#include <tuple>
+#include <memory>
+#include <thread>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <iostream>
+
+#include "hash.hpp"
+#include "hugePages.hpp"
+#include "batchLookup.hpp"
+#include "mappedIndex.hpp"
+#include "seedExtension.hpp"
+#include "indexGenome.hpp"
+#include "packGenomeBlob.hpp"
+#include "referenceCollection.hpp"
+#include "syntheticGenome.hpp"
+#include "encode_kmer_2bit.h"
+#include "protected_vector.hpp"
+#include "serialiseKmersMap.hpp"
+#include "shardIndex.hpp"
+#include "indexMetadata.hpp"
+
+/*
+	CLASS BENCHMARK_RESULT
+	----------------------
+*/
+class benchmark_result
+	{
+	public:
+		std::string name;
+		uint64_t operations;
+		double seconds;			// best of the iterations
+	};
+
+std::vector<benchmark_result> results;
+synthetic_genome_parameters GENOME;
+uint32_t ITERATIONS = 3; // each benchmark is run this many times and the fastest is reported
+uint64_t LOOKUPS = 1000000; // number of random bucket lookups
+std::string JSON_FILENAME = "bench_results.json";
+std::string FASTA_FILENAME = ""; // if set, write the synthetic genome here
+std::string SCRATCH = "bench"; // base name for the index files written (and removed) by the serialisation benchmarks
+uint32_t FILES = 1000; // the reference collection benchmark splits the genome into this many files
+std::string HUGE_PAGES = "both"; // run the index benchmarks with huge pages "yes", "no", or "both"
+bool CHECK = false; // run the correctness checks (not the benchmarks) and exit non-zero if one fails
+std::string INDEXER = ""; // -check builds and appends to indexes with this indexReference (if set)
+uint64_t DISAGREEMENTS = 0; // the number of correctness checks that failed, the run exits non-zero if there are any
+
+/*
+	The result of each benchmark is folded into this so that the compiler cannot throw the work away
+*/
+volatile uint64_t sink;
+
+/*
+	MEASURE()
+	---------
+	Run function ITERATIONS times, keep the fastest.  If setup is given it is run (untimed) before each iteration.
+*/
+template <typename SETUP, typename FUNCTION>
+void measure(const std::string &name, uint64_t operations, SETUP setup, FUNCTION function)
+	{
+	benchmark_result result = {name, operations, HUGE_VAL};
+
+	for (uint32_t iteration = 0; iteration < ITERATIONS; iteration++)
+		{
+		setup();
+		auto start = std::chrono::steady_clock::now();
+		function();
+		auto end = std::chrono::steady_clock::now();
+		result.seconds = std::min(result.seconds, std::chrono::duration<double>(end - start).count());
+		}
+
+	printf("%-56s %14llu ops %10.4f sec %12.2f Mops/sec %10.2f ns/op\n", name.c_str(), (unsigned long long)operations, result.seconds, operations / result.seconds / 1e6, result.seconds * 1e9 / operations);
+	fflush(stdout);
+	results.push_back(result);
+	}
+
+template <typename FUNCTION>
+void measure(const std::string &name, uint64_t operations, FUNCTION function)
+	{
+	measure(name, operations, [](){}, function);
+	}
+
+/*
+	DISAGREE()
+	----------
+	Count a failed correctness check (so that the run exits non-zero) and start its error message.
+*/
+std::ostream &disagree(void)
+	{
+	DISAGREEMENTS++;
+	return std::cerr << "Error: ";
+	}
+
+/*
+	HIT_DIFFERENCES()
+	-----------------
+	The number of hits found by only one of two lookups of the same k-mers (in whatever order each found them).
+*/
+uint64_t hit_differences(std::vector<lookup_hit> expected, std::vector<lookup_hit> found)
+	{
+	auto order = [](const lookup_hit &one, const lookup_hit &two)
+		{
+		return std::make_tuple(one.query, one.position, one.reverse, one.masked) < std::make_tuple(two.query, two.position, two.reverse, two.masked);
+		};
+	std::sort(expected.begin(), expected.end(), order);
+	std::sort(found.begin(), found.end(), order);
+
+	std::vector<lookup_hit> different;
+	std::set_symmetric_difference(expected.begin(), expected.end(), found.begin(), found.end(), std::back_inserter(different), order);
+	return different.size();
+	}
+
+/*
+	BENCH_ENCODING()
+	----------------
+	pack_32mer() at every position against the rolling encoder used by index_kmers_thread().
+*/
+void bench_encoding(const char *genome, uint64_t genomeSize)
+	{
+	uint64_t kmers = genomeSize - 32;
+
+	measure("encode/pack_32mer", kmers, [=]()
+		{
+		uint64_t total = 0;
+		for (uint64_t pos = 0; pos < kmers; pos++)
+			total += encode_kmer_2bit::pack_32mer(genome + pos);
+		sink = total;
+		});
+
+	measure("encode/rolling_canonical", kmers, [=]()
+		{
+		uint64_t total = 0;
+		uint64_t pkmer = encode_kmer_2bit::pack_32mer(genome);
+		uint64_t remkp = encode_kmer_2bit::reverse_complement_32mer(pkmer);
+		pkmer >>= 2;
+		remkp <<= 2;
+		const char *encode_pos = genome + 31;
+		for (uint64_t pos = 0; pos < kmers; pos++)
+			{
+			uint64_t new_base = encode_kmer_2bit::pack_1mer(*encode_pos++);
+			pkmer = (pkmer << 2) | new_base;
+			remkp = (remkp >> 2) | (~new_base << 62);
+			total += pkmer ^ remkp;
+			}
+		sink = total;
+		});
+	}
+
+/*
+	BENCH_HASH()
+	------------
+*/
+template <typename HASH>
+void bench_hash(const std::string &name, const std::vector<uint64_t> &canonical, uint64_t rounds)
+	{
+	measure("hash/" + name, rounds * canonical.size(), [&]()
+		{
+		uint64_t total = 0;
+		for (uint64_t round = 0; round < rounds; round++)
+			for (uint64_t kmer : canonical)
+				total += HASH::hash(kmer);
+		sink = total;
+		});
+	}
+
+/*
+	CLASS CRC32C_SOFTWARE_HASH
+	--------------------------
+	crc32c_hash as it is on a CPU without the CRC32 instruction.
+*/
+class crc32c_software_hash
+	{
+	public:
+		static inline uint32_t hash(uint64_t key)
+			{
+			return crc32c_hash::software(key);
+			}
+	};
+
+/*
+	CHECK_CRC32C()
+	--------------
+	crc32c_hash (with the CRC32 instruction, if this CPU has it) must give the same hashes as the software crc32c.
+*/
+void check_crc32c(const std::vector<uint64_t> &canonical)
+	{
+	uint64_t wrong = 0;
+	for (uint64_t kmer : canonical)
+		wrong += crc32c_hash::hash(kmer) != crc32c_software_hash::hash(kmer);
+	if (wrong != 0)
+		disagree() << "the CRC32 instruction and the software crc32c disagree on " << wrong << " of " << canonical.size() << " k-mers" << std::endl;
+	}
+
+/*
+	BENCH_HASHING()
+	---------------
+	Each bucket hash policy over (a cache-resident sample of) the genome's canonical k-mers.  crc32c is also measured in
+	software, which must give the same hashes.
+*/
+void bench_hashing(const char *genome, uint64_t genomeSize)
+	{
+	std::vector<uint64_t> canonical(std::min<uint64_t>(genomeSize - 32, 1 << 20));
+	for (uint64_t pos = 0; pos < canonical.size(); pos++)
+		{
+		uint64_t kmer = encode_kmer_2bit::pack_32mer(genome + pos);
+		canonical[pos] = kmer ^ encode_kmer_2bit::reverse_complement_32mer(kmer);
+		}
+	uint64_t rounds = std::max<uint64_t>(1, (genomeSize - 32) / canonical.size());
+
+	bench_hash<murmur_hash>("murmur", canonical, rounds);
+	bench_hash<xor_fold_hash>("xor", canonical, rounds);
+	bench_hash<multiply_shift_hash>("multiplyShift", canonical, rounds);
+	bench_hash<crc32c_hash>(crc32c_in_hardware() ? "crc32c" : "crc32c_software", canonical, rounds);
+	if (crc32c_in_hardware())
+		{
+		bench_hash<crc32c_software_hash>("crc32c_software", canonical, 1);
+		check_crc32c(canonical);
+		}
+	bench_hash<wyhash_mix_hash>("wyhash", canonical, rounds);
+	}
+
+/*
+	BENCH_PROTECTED_VECTOR()
+	------------------------
+	push_back() from every thread into a small (contended) and a large (uncontended) set of buckets.
+*/
+void bench_protected_vector(uint64_t pushes)
+	{
+	size_t thread_count = std::max(2U, std::thread::hardware_concurrency());
+
+	for (uint64_t bucket_count : {uint64_t(16), uint64_t(1) << 20})
+		{
+		std::vector<protected_vector<uint32_t>> buckets;
+
+		measure("protected_vector/push_back/" + std::to_string(thread_count) + "_threads/" + std::to_string(bucket_count) + "_buckets", pushes,
+			[&]()
+				{
+				std::vector<protected_vector<uint32_t>>(bucket_count).swap(buckets);
+				},
+			[&]()
+				{
+				std::vector<std::thread> threads;
+				for (size_t thread = 0; thread < thread_count; thread++)
+					threads.push_back(std::thread([&, thread]()
+						{
+						uint64_t state = thread + 1;
+						for (uint64_t push = thread; push < pushes; push += thread_count)
+							{
+							state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+							buckets[(state >> 32) & (bucket_count - 1)].push_back(static_cast<uint32_t>(push));
+							}
+						}));
+				for (auto &thread : threads)
+					thread.join();
+				});
+		}
+	}
+
+/*
+	BENCH_PACKGENOME()
+	------------------
+*/
+void bench_packGenome(const std::string &fasta)
+	{
+	std::vector<char> buffer(fasta.size() + 1);
+	std::map<uint32_t, std::string> referenceIDMap;
+
+	measure("packGenome", fasta.size(),
+		[&]()
+			{
+			memcpy(buffer.data(), fasta.c_str(), fasta.size() + 1);
+			referenceIDMap.clear();
+			},
+		[&]()
+			{
+			sink = packGenome(buffer.data(), fasta.size(), referenceIDMap);
+			});
+	}
+
+/*
+	BENCH_LOAD()
+	------------
+	Load the genome as one FASTA file and as a collection of FILES small files (as a directory), to measure the per-file overhead.
+*/
+void bench_load(const std::string &fasta)
+	{
+	std::string directory = SCRATCH + "_files";
+	std::string single = directory + "/all.fasta";
+	mkdir(directory.c_str(), 0755);
+	writeTextBlobToFile(fasta.c_str(), fasta.size(), single);
+
+	/*
+		Split at line ends, each piece its own record
+	*/
+	std::vector<std::string> pieces;
+	uint64_t piece_size = std::max<uint64_t>(1, fasta.size() / std::max<uint32_t>(FILES, 1));
+	for (uint64_t from = 0; from < fasta.size(); )
+		{
+		uint64_t to = std::min<uint64_t>(fasta.size(), from + piece_size);
+		while (to < fasta.size() && fasta[to - 1] != '\n')
+			to++;
+		char name[32];
+		snprintf(name, sizeof(name), "/piece%06zu.fasta", pieces.size());
+		pieces.push_back(directory + name);
+		std::string text = (fasta[from] == '>' ? "" : ">" + std::string(name + 1) + "\n") + fasta.substr(from, to - from);
+		writeTextBlobToFile(text.c_str(), text.size(), pieces.back());
+		from = to;
+		}
+
+	for (const auto &files : {std::vector<std::string>(1, single), pieces})
+		measure("load/" + std::to_string(files.size()) + (files.size() == 1 ? "_file" : "_files"), fasta.size(), [&]()
+			{
+			std::map<uint32_t, std::string> referenceIDMap;
+			std::map<uint32_t, std::string> fileIDMap;
+			uint64_t genomeSize;
+			huge_pages::release(load_genome_files(files, referenceIDMap, fileIDMap, genomeSize));
+			sink = genomeSize;
+			});
+
+	for (const auto &piece : pieces)
+		remove(piece.c_str());
+	remove(single.c_str());
+	rmdir(directory.c_str());
+	}
+
+/*
+	BENCH_PREFILTER()
+	-----------------
+	Lookups of noisy k-mers (genome k-mers with one base changed, as a sequencing error would, so most are not in the genome)
+	with and without a 10 bit per k-mer prefilter in front of the index.  The prefilter must not change the hits, and its
+	false positive rate is the proportion of the k-mers not in the genome that it lets through.
+*/
+void bench_prefilter(char *genome, uint64_t genomeSize, const std::map<uint32_t, std::string> &referenceIDMap, index_view view, const std::vector<uint64_t> &kmers, const std::string &suffix)
+	{
+	blocked_bloom_filter prefilter(genomeSize, 10);
+	huge_page_vector<protected_vector<uint32_t>> noMap;
+	index_kmers(genome, genomeSize, noMap, view.MASK, 0, &prefilter, view.hash, &referenceIDMap);
+
+	std::mt19937_64 random(GENOME.seed + 1);
+	std::vector<uint64_t> noisy(kmers.size());
+	for (size_t which = 0; which < noisy.size(); which++)
+		noisy[which] = kmers[which] ^ ((random() % 3 + 1) << (2 * (random() % 32)));
+
+	std::vector<lookup_hit> hits;
+	std::vector<lookup_hit> filteredHits;
+	const blocked_bloom_filter *filters[] = {nullptr, &prefilter};
+	for (const blocked_bloom_filter *filter : filters)
+		{
+		std::vector<lookup_hit> &found = filter == nullptr ? hits : filteredHits;
+		view.prefilter = filter;
+		std::string name = filter == nullptr ? "/unfiltered" : "/prefiltered";
+		measure("lookup/noisy" + name + "/one_at_a_time" + suffix, noisy.size(), [&]() { found.clear(); }, [&]()
+			{
+			lookup_kmers(view, noisy.data(), noisy.size(), found);
+			});
+		size_t expected = found.size();
+		measure("lookup/noisy" + name + "/interleaved_16" + suffix, noisy.size(), [&]() { found.clear(); }, [&]()
+			{
+			lookup_kmers_interleaved(view, noisy.data(), noisy.size(), found, 16);
+			});
+		if (found.size() != expected)
+			disagree() << "interleaved lookup of noisy k-mers found " << found.size() << " hits, expected " << expected << std::endl;
+		}
+	if (filteredHits.size() != hits.size())
+		disagree() << "the prefilter changed the noisy k-mer hits from " << hits.size() << " to " << filteredHits.size() << std::endl;
+
+	std::vector<char> present(noisy.size());
+	for (const auto &hit : hits)
+		present[hit.query] = true;
+	uint64_t absent = 0;
+	uint64_t passed = 0;
+	for (size_t which = 0; which < noisy.size(); which++)
+		if (!present[which])
+			{
+			absent++;
+			passed += prefilter.possibly_contains(noisy[which] ^ encode_kmer_2bit::reverse_complement_32mer(noisy[which]));
+			}
+	std::cout << "Prefilter" << suffix << ": " << prefilter.size_in_bytes() / (1024 * 1024) << " MB, " << absent << " of " << noisy.size() << " noisy k-mers absent, " << passed * 100.0 / std::max<uint64_t>(1, absent) << "% false positives" << std::endl;
+	}
+
+/*
+	BENCH_INDEX()
+	-------------
+	Build the index, serialise it, deserialise it, and look up random k-mers from the genome.  The genome is copied so that
+	it, like the index, is allocated with huge pages on or off as huge_pages::enabled says.  suffix is added to each name.
+*/
+void bench_index(const char *originalGenome, uint64_t genomeSize, const std::map<uint32_t, std::string> &referenceIDMap, const std::string &suffix)
+	{
+	char *genome = static_cast<char *>(huge_pages::allocate(genomeSize + 1));
+	memcpy(genome, originalGenome, genomeSize + 1);
+
+	int numBitsToKeep = ::ceil(::log2(genomeSize));
+	uint32_t MASK = (numBitsToKeep == 32) ? UINT32_MAX : (1 << numBitsToKeep) - 1;
+	huge_page_vector<protected_vector<uint32_t>> kmersMap;
+
+	measure("index_kmers" + suffix, genomeSize - 32,
+		[&]()
+			{
+			huge_page_vector<protected_vector<uint32_t>>(pow(2, numBitsToKeep)).swap(kmersMap);
+			},
+		[&]()
+			{
+			index_kmers(genome, genomeSize, kmersMap, MASK, 0, nullptr, MURMUR_HASH, &referenceIDMap);
+			});
+
+	std::string innerMapFilename = SCRATCH + "_32_InnerBlob.idx";
+	std::string outerMapFilename = SCRATCH + "_32_OuterBlob.idx";
+	measure("serializeMap" + suffix, genomeSize - 32, [&]()
+		{
+		serializeMap(kmersMap, innerMapFilename, outerMapFilename);
+		});
+
+	huge_page_vector<uint32_t> innerMapBlob;
+	huge_page_vector<uint32_t> outerMapBlob;
+	measure("deserializeMap" + suffix, genomeSize - 32, [&]()
+		{
+		deserializeMap(innerMapFilename, outerMapFilename, innerMapBlob, outerMapBlob);
+		});
+	remove(innerMapFilename.c_str());
+	remove(outerMapFilename.c_str());
+
+	/*
+		Random k-mers that are in the index (so every lookup is a hit), that is, windows of A, C, G and T within one record
+	*/
+	std::mt19937_64 random(GENOME.seed);
+	std::vector<uint64_t> kmers(LOOKUPS);
+	std::vector<uint64_t> queries(LOOKUPS);
+	for (size_t which = 0; which < queries.size(); which++)
+		{
+		uint64_t position;
+		bool indexed;
+		do
+			{
+			position = random() % (genomeSize - 32);
+			auto next_record = referenceIDMap.upper_bound(position);
+			indexed = next_record == referenceIDMap.end() || next_record->first >= position + 32;
+			for (uint64_t base = position; base < position + 32; base++)
+				indexed = indexed && encode_kmer_2bit::is_base(genome[base]);
+			}
+		while (!indexed);
+		kmers[which] = encode_kmer_2bit::pack_32mer(genome + position);
+		queries[which] = kmers[which] ^ encode_kmer_2bit::reverse_complement_32mer(kmers[which]);
+		}
+
+	measure("lookup/getInnerVector" + suffix, queries.size(), [&]()
+		{
+		uint64_t total = 0;
+		for (uint64_t query : queries)
+			total += getInnerVector(innerMapBlob, outerMapBlob, murmurHash3(query) & MASK).size();
+		sink = total;
+		});
+
+	/*
+		Verified lookups one at a time against interleaved (AMAC) lookups
+	*/
+	index_view view(innerMapBlob, outerMapBlob, genome, genomeSize);
+	std::vector<lookup_hit> hits;
+	hits.reserve(kmers.size() * 4);
+
+	measure("lookup/verified/one_at_a_time" + suffix, kmers.size(), [&]() { hits.clear(); }, [&]()
+		{
+		lookup_kmers(view, kmers.data(), kmers.size(), hits);
+		});
+	size_t expected = hits.size();
+
+	for (size_t in_flight : {8, 16, 32})
+		{
+		measure("lookup/verified/interleaved_" + std::to_string(in_flight) + suffix, kmers.size(), [&]() { hits.clear(); }, [&]()
+			{
+			lookup_kmers_interleaved(view, kmers.data(), kmers.size(), hits, in_flight);
+			});
+		if (hits.size() != expected)
+			disagree() << "interleaved lookup found " << hits.size() << " hits, expected " << expected << std::endl;
+		}
+
+	bench_prefilter(genome, genomeSize, referenceIDMap, view, kmers, suffix);
+
+	/*
+		The same lookups against the inline layout, where buckets of one or two positions need no InnerBlob read
+	*/
+	measure("serializeMap/inline" + suffix, genomeSize - 32, [&]()
+		{
+		serializeMap(kmersMap, innerMapFilename, outerMapFilename, INLINE_LAYOUT);
+		});
+	huge_page_vector<uint32_t> inlineInnerMapBlob;
+	huge_page_vector<uint32_t> inlineOuterMapBlob;
+	deserializeMap(innerMapFilename, outerMapFilename, inlineInnerMapBlob, inlineOuterMapBlob, INLINE_LAYOUT);
+	remove(innerMapFilename.c_str());
+	remove(outerMapFilename.c_str());
+	std::cout << "Blob sizes" << suffix << ": offsets " << (innerMapBlob.size() + outerMapBlob.size()) * sizeof(uint32_t) / (1024 * 1024) << " MB, inline " << (inlineInnerMapBlob.size() + inlineOuterMapBlob.size()) * sizeof(uint32_t) / (1024 * 1024) << " MB" << std::endl;
+
+	index_view inlineView(inlineInnerMapBlob, inlineOuterMapBlob, genome, genomeSize, MURMUR_HASH, INLINE_LAYOUT);
+	measure("lookup/verified/one_at_a_time/inline" + suffix, kmers.size(), [&]() { hits.clear(); }, [&]()
+		{
+		lookup_kmers(inlineView, kmers.data(), kmers.size(), hits);
+		});
+	if (hits.size() != expected)
+		disagree() << "inline lookup found " << hits.size() << " hits, expected " << expected << std::endl;
+
+	for (size_t in_flight : {8, 16, 32})
+		{
+		measure("lookup/verified/interleaved_" + std::to_string(in_flight) + "/inline" + suffix, kmers.size(), [&]() { hits.clear(); }, [&]()
+			{
+			lookup_kmers_interleaved(inlineView, kmers.data(), kmers.size(), hits, in_flight);
+			});
+		if (hits.size() != expected)
+			disagree() << "inline interleaved lookup found " << hits.size() << " hits, expected " << expected << std::endl;
+		}
+
+	uint64_t allocated;
+	uint64_t huge;
+	huge_pages::coverage(allocated, huge);
+	std::cout << "Huge page coverage" << suffix << ": " << huge / (1024 * 1024) << " MB of " << allocated / (1024 * 1024) << " MB" << std::endl;
+
+	huge_pages::release(genome);
+	}
+
+/*
+	EVICT()
+	-------
+	Drop a file from the page cache (as far as the kernel allows) so that the next read of it goes to the disk.
+*/
+void evict(const std::string &filename)
+	{
+	int file = open(filename.c_str(), O_RDONLY);
+	if (file < 0)
+		return;
+	fdatasync(file);
+	posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+	close(file);
+	}
+
+/*
+	WRITE_INDEX()
+	-------------
+	Write kmersMap and the genome as the index baseName in the given layout.  Returns the names of the files written.
+*/
+std::vector<std::string> write_index(huge_page_vector<protected_vector<uint32_t>> &kmersMap, const char *genome, uint64_t genomeSize, const std::string &baseName, bucket_layout layout)
+	{
+	std::vector<std::string> files = {baseName + "_32_InnerBlob.idx", baseName + "_32_OuterBlob.idx", baseName + "_genome.idx", indexMetadataFilename(baseName)};
+	serializeMap(kmersMap, files[0], files[1], layout);
+	writeTextBlobToFile(genome, genomeSize, files[2]);
+	index_metadata metadata;
+	metadata.layout = layout;
+	metadata.serialize(files[3]);
+
+	return files;
+	}
+
+/*
+	CHECK_MAPPED()
+	--------------
+	The mapped index must give exactly the hits the deserialised one does, for every k-mer of the genome, while the warmer
+	is faulting it in underneath the lookups.  files are the index's files, as write_index() returns them.
+*/
+void check_mapped(const std::string &baseName, const std::vector<std::string> &files, bucket_layout layout, const char *genome, uint64_t genomeSize)
+	{
+	huge_page_vector<uint32_t> innerMapBlob;
+	huge_page_vector<uint32_t> outerMapBlob;
+	deserializeMap(files[0], files[1], innerMapBlob, outerMapBlob, layout);
+	index_view eager(innerMapBlob, outerMapBlob, genome, genomeSize, MURMUR_HASH, layout);
+
+	for (const auto &file : files)
+		evict(file);
+	mapped_index index;
+	if (!index.open(baseName))
+		{
+		disagree() << "cannot open the mapped " << bucket_layout_name(layout) << " index" << std::endl;
+		return;
+		}
+	index_warmer warmer;
+	warmer.start(index);
+
+	std::vector<uint64_t> kmers;
+	std::vector<lookup_hit> expected;
+	std::vector<lookup_hit> found;
+	uint64_t total_hits = 0;
+	uint64_t wrong = 0;
+	for (uint64_t start = 0; start + 32 <= genomeSize; start += LOOKUPS)
+		{
+		kmers.clear();
+		for (uint64_t position = start; position < std::min(genomeSize - 31, start + LOOKUPS); position++)
+			kmers.push_back(encode_kmer_2bit::pack_32mer(genome + position));
+		expected.clear();
+		found.clear();
+		lookup_kmers(eager, kmers.data(), kmers.size(), expected);
+		lookup_kmers_interleaved(index.view(), kmers.data(), kmers.size(), found);
+		total_hits += expected.size();
+		wrong += hit_differences(expected, found);
+		}
+	uint64_t warmed = warmer.warmed();
+	warmer.wait();
+
+	if (wrong != 0)
+		disagree() << "the mapped " << bucket_layout_name(layout) << " index differs from the deserialised one in " << wrong << " of " << total_hits << " hits" << std::endl;
+	else
+		std::cout << "Mapped " << bucket_layout_name(layout) << " index: all " << total_hits << " hits of the genome's " << genomeSize - 31 << " k-mers as deserialised (" << warmed * 100 / std::max<uint64_t>(1, warmer.size()) << "% warm at the end)" << std::endl;
+	}
+
+/*
+	BENCH_OPEN()
+	------------
+	The time from opening an index to its first verified lookup, reading it all up front (deserializeMap() and
+	readTextBlobFromFile()) against mapping it (mapped_index), and how long the background warm-up takes to have it all in
+	memory.  Each iteration starts with the index files evicted from the page cache.  Then, in each layout, every k-mer of
+	the genome is looked up in the mapped index while it warms, and the hits are checked against the deserialised index.
+*/
+void bench_open(char *genome, uint64_t genomeSize, const std::map<uint32_t, std::string> &referenceIDMap)
+	{
+	int numBitsToKeep = ::ceil(::log2(genomeSize));
+	uint32_t MASK = (numBitsToKeep == 32) ? UINT32_MAX : (1 << numBitsToKeep) - 1;
+	huge_page_vector<protected_vector<uint32_t>> kmersMap(pow(2, numBitsToKeep));
+	index_kmers(genome, genomeSize, kmersMap, MASK, 0, nullptr, MURMUR_HASH, &referenceIDMap);
+
+	/*
+		The index is written in both layouts, the timings are of the offsets one
+	*/
+	std::string baseNames[2];
+	std::vector<std::string> layoutFiles[2];
+	for (bucket_layout layout : {OFFSET_LAYOUT, INLINE_LAYOUT})
+		{
+		baseNames[layout] = SCRATCH + "_open_" + bucket_layout_name(layout);
+		layoutFiles[layout] = write_index(kmersMap, genome, genomeSize, baseNames[layout], layout);
+		}
+	huge_page_vector<protected_vector<uint32_t>>().swap(kmersMap);
+	const std::string &baseName = baseNames[OFFSET_LAYOUT];
+	const std::vector<std::string> &files = layoutFiles[OFFSET_LAYOUT];
+
+	/*
+		The first query is the k-mer from the middle of the genome
+	*/
+	uint64_t kmer = encode_kmer_2bit::pack_32mer(genome + genomeSize / 2);
+	std::vector<lookup_hit> hits;
+	auto evict_all = [&]()
+		{
+		for (const auto &file : files)
+			evict(file);
+		hits.clear();
+		};
+
+	measure("open/eager/first_lookup", 1, evict_all, [&]()
+		{
+		huge_page_vector<uint32_t> innerMapBlob;
+		huge_page_vector<uint32_t> outerMapBlob;
+		deserializeMap(files[0], files[1], innerMapBlob, outerMapBlob);
+		char *text;
+		uint64_t textSize;
+		std::tie(text, textSize) = readTextBlobFromFile(files[2]);
+		lookup_kmers(index_view(innerMapBlob, outerMapBlob, text, textSize), &kmer, 1, hits);
+		delete [] text;
+		});
+	size_t expected = hits.size();
+
+	measure("open/lazy/first_lookup", 1, evict_all, [&]()
+		{
+		mapped_index index;
+		index.open(baseName);
+		lookup_kmers(index.view(), &kmer, 1, hits);
+		});
+	if (hits.size() != expected)
+		disagree() << "the mapped index found " << hits.size() << " hits for the first query, expected " << expected << std::endl;
+
+	uint64_t bytes = 0;
+	measure("open/lazy/warm_up", 1, evict_all, [&]()
+		{
+		mapped_index index;
+		index.open(baseName);
+		index_warmer warmer;
+		warmer.start(index);
+		warmer.wait();
+		bytes = warmer.warmed();
+		});
+	std::cout << "Warmed " << bytes / (1024 * 1024) << " MB with " << std::max(1U, std::thread::hardware_concurrency()) << " threads" << std::endl;
+
+	for (bucket_layout layout : {OFFSET_LAYOUT, INLINE_LAYOUT})
+		check_mapped(baseNames[layout], layoutFiles[layout], layout, genome, genomeSize);
+
+	for (const auto &written : layoutFiles)
+		for (const auto &file : written)
+			remove(file.c_str());
+	}
+
+/*
+	SCALAR_EXTEND()
+	---------------
+	extend_seed() a byte at a time, the baseline for (and check of) the SIMD and 2-bit kernels.
+*/
+seed_match scalar_extend(const char *genome, uint64_t first, uint64_t last, const seed_query &query, uint32_t seed, uint32_t position)
+	{
+	seed_match match = {0, position, 0, false};
+
+	if (seed + 32ULL > query.length || position < first || position + 32ULL > last)
+		return match;
+
+	for (int strand = 0; strand < 2; strand++)
+		{
+		const char *sequence = query.ascii[strand].data() + seed_query::PADDING;
+		uint64_t from = strand == 0 ? seed : query.length - 32 - seed;
+		uint64_t right = 0;
+		uint64_t left = 0;
+		while (from + right < query.length && position + right < last && (genome[position + right] | 0x20) == sequence[from + right])
+			right++;
+		if (right < 32)
+			continue;
+		while (left < from && position - left > first && (genome[position - left - 1] | 0x20) == sequence[from - left - 1])
+			left++;
+
+		match.length = static_cast<uint32_t>(left + right);
+		match.position = static_cast<uint32_t>(position - left);
+		match.query_start = static_cast<uint32_t>(strand == 0 ? from - left : query.length - (from - left) - match.length);
+		match.reverse = strand == 1;
+		break;
+		}
+
+	return match;
+	}
+
+/*
+	BENCH_EXTENSION()
+	-----------------
+	Verify and extend seeds of simulated 150 base reads: half from the reverse strand, each with a few substitutions, and a
+	quarter of the seeds paired with a random (wrong) position as a bucket collision would be.  The packed 32-mer compare
+	used by lookup_kmers() (verification only, no extension) is included for comparison.
+*/
+void bench_extension(const char *genome, uint64_t genomeSize, const std::map<uint32_t, std::string> &referenceIDMap)
+	{
+	static const uint32_t READ_LENGTH = 150;
+	static const size_t SEEDS_PER_READ = 100;
+
+	class seed_hit
+		{
+		public:
+			uint32_t read;
+			uint32_t seed;
+			uint32_t position;
+			uint64_t first;		// the record holding position
+			uint64_t last;
+		};
+
+	if (genomeSize < 2 * READ_LENGTH)
+		return;
+
+	std::mt19937_64 random(GENOME.seed);
+	size_t read_count = std::max<size_t>(1, LOOKUPS / SEEDS_PER_READ);
+	std::vector<seed_query> reads(read_count);
+	std::vector<seed_hit> hits;
+	std::vector<uint64_t> seeds;
+	std::string read;
+
+	auto record_of = [&](uint64_t position, uint64_t &first, uint64_t &last)
+		{
+		auto next_record = referenceIDMap.upper_bound(position);
+		last = next_record == referenceIDMap.end() ? genomeSize : next_record->first;
+		first = next_record == referenceIDMap.begin() ? 0 : (--next_record)->first;
+		};
+
+	for (uint32_t which = 0; which < read_count; which++)
+		{
+		uint64_t start = random() % (genomeSize - READ_LENGTH);
+		bool reverse = random() % 2 == 1;
+		read.assign(genome + start, READ_LENGTH);
+		for (int substitution = 0; substitution < 3; substitution++)
+			read[random() % READ_LENGTH] = "ACGT"[random() % 4];
+		if (reverse)
+			{
+			std::reverse(read.begin(), read.end());
+			for (char &base : read)
+				base = base == 'A' ? 'T' : base == 'C' ? 'G' : base == 'G' ? 'C' : base == 'T' ? 'A' : base;
+			}
+		reads[which].assign(read.data(), READ_LENGTH);
+
+		for (size_t seed = 0; seed < SEEDS_PER_READ; seed++)
+			{
+			seed_hit hit;
+			hit.read = which;
+			hit.seed = random() % (READ_LENGTH - 32 + 1);
+			uint64_t offset = reverse ? READ_LENGTH - 32 - hit.seed : hit.seed;
+			hit.position = random() % 4 == 0 ? random() % (genomeSize - 32) : start + offset;
+			record_of(hit.position, hit.first, hit.last);
+			hits.push_back(hit);
+			seeds.push_back(encode_kmer_2bit::pack_32mer(read.data() + hit.seed));
+			}
+		}
+
+	packed_genome packed;
+	measure("extend/pack_genome", genomeSize, [&]()
+		{
+		packed.assign(genome, genomeSize);
+		});
+
+	std::vector<seed_match> expected(hits.size());
+	std::vector<seed_match> found(hits.size());
+
+	measure("extend/verify_only/pack_32mer", hits.size(), [&]()
+		{
+		uint64_t total = 0;
+		for (size_t which = 0; which < hits.size(); which++)
+			{
+			uint64_t kmer = encode_kmer_2bit::pack_32mer(genome + hits[which].position);
+			total += kmer == seeds[which] || kmer == encode_kmer_2bit::reverse_complement_32mer(seeds[which]);
+			}
+		sink = total;
+		});
+
+	measure("extend/scalar", hits.size(), [&]()
+		{
+		for (size_t which = 0; which < hits.size(); which++)
+			expected[which] = scalar_extend(genome, hits[which].first, hits[which].last, reads[hits[which].read], hits[which].seed, hits[which].position);
+		});
+
+	auto check = [&](const char *kernel)
+		{
+		size_t wrong = 0;
+		for (size_t which = 0; which < hits.size(); which++)
+			{
+			const seed_match &want = expected[which];
+			const seed_match &got = found[which];
+			wrong += want.length != got.length || (want.length != 0 && (want.position != got.position || want.query_start != got.query_start || want.reverse != got.reverse));
+			}
+		if (wrong != 0)
+			disagree() << "the " << kernel << " kernel disagrees with the scalar one on " << wrong << " of " << hits.size() << " seeds" << std::endl;
+		};
+
+	measure("extend/ascii_simd", hits.size(), [&]()
+		{
+		for (size_t which = 0; which < hits.size(); which++)
+			found[which] = extend_seed(genome, hits[which].first, hits[which].last, reads[hits[which].read], hits[which].seed, hits[which].position);
+		});
+	check("ascii");
+
+	measure("extend/packed_2bit", hits.size(), [&]()
+		{
+		for (size_t which = 0; which < hits.size(); which++)
+			found[which] = extend_seed(packed, hits[which].first, hits[which].last, reads[hits[which].read], hits[which].seed, hits[which].position);
+		});
+	check("2-bit");
+
+	uint64_t verified = 0;
+	uint64_t matched = 0;
+	for (const auto &match : expected)
+		if (match.length != 0)
+			{
+			verified++;
+			matched += match.length;
+			}
+	std::cout << "Seeds verified: " << verified << " of " << hits.size() << ", mean match " << (verified == 0 ? 0 : matched / verified) << " bases" << std::endl;
+	}
+
+/*
+	CHECK_EXTENSION()
+	-----------------
+	Check both extend_seed() kernels against scalar_extend() on GENOMES small random genomes, each allocated to exactly its
+	length (so a read past either end is caught by the padding or not at all), holding lower case bases, runs of N and other
+	bytes that are not bases, and repeats so that matches run on past the seed.  Each has QUERIES reads taken from it (either
+	strand, with substitutions and Ns) and each read SEEDS seeds, at the read's position or a random one, in records whose
+	edges are random so that extension stops at them.
+*/
+void check_extension(void)
+	{
+	static const size_t GENOMES = 200;
+	static const size_t QUERIES = 200;
+	static const size_t SEEDS = 20;
+
+	auto same = [](const seed_match &want, const seed_match &got)
+		{
+		return want.length == got.length && (want.length == 0 || (want.position == got.position && want.query_start == got.query_start && want.reverse == got.reverse));
+		};
+
+	std::mt19937_64 random(GENOME.seed);
+	size_t wrong = 0;
+	size_t matched = 0;
+	std::string bases;
+	std::string read;
+	seed_query query;
+	packed_genome packed;
+
+	for (size_t which = 0; which < GENOMES; which++)
+		{
+		uint64_t size = 40 + random() % 300;
+		bases.clear();
+		while (bases.size() < size)
+			if (random() % 300 == 0)
+				bases.append(1 + random() % 40, "Nn"[random() % 2]);
+			else if (random() % 50 == 0)
+				bases += "NnRY\x90\xff"[random() % 6];
+			else if (bases.size() > 40 && random() % 4 != 0)
+				bases += bases[bases.size() - 37];
+			else
+				bases += "ACGTacgt"[random() % 8];
+		std::unique_ptr<char[]> genome(new char[size]);
+		memcpy(genome.get(), bases.data(), size);
+		packed.assign(genome.get(), size);
+
+		for (size_t each = 0; each < QUERIES; each++)
+			{
+			uint64_t length = 32 + random() % 120;
+			uint64_t start = size > length ? random() % (size - length + 1) : 0;
+			read.assign(bases, start, length);
+			read.resize(std::max<size_t>(read.size(), 32), 'A');
+			length = read.size();
+			bool reverse = random() % 2 == 1;
+			if (reverse)
+				{
+				std::reverse(read.begin(), read.end());
+				for (char &base : read)
+					base = (base | 0x20) == 'a' ? 'T' : (base | 0x20) == 'c' ? 'G' : (base | 0x20) == 'g' ? 'C' : (base | 0x20) == 't' ? 'A' : 'N';
+				}
+			for (uint64_t substitution = random() % 3; substitution > 0; substitution--)
+				read[random() % length] = "ACGTN"[random() % 5];
+			query.assign(read.data(), length);
+
+			for (size_t seed_number = 0; seed_number < SEEDS; seed_number++)
+				{
+				uint32_t seed = random() % (length - 31);
+				uint32_t position = random() % (size - 31);
+				uint64_t offset = reverse ? length - 32 - seed : seed;
+				if (random() % 2 == 1 && start + offset + 32 <= size)
+					position = start + offset;
+				uint64_t first = random() % 3 == 0 ? random() % (position + 1) : 0;
+				uint64_t last = random() % 3 == 0 ? position + 32 + random() % (size - position - 31) : size;
+
+				seed_match want = scalar_extend(genome.get(), first, last, query, seed, position);
+				seed_match ascii = extend_seed(genome.get(), first, last, query, seed, position);
+				seed_match two_bit = extend_seed(packed, first, last, query, seed, position);
+				for (const seed_match *got : {&ascii, &two_bit})
+					if (!same(want, *got))
+						{
+						if (wrong++ < 10)
+							std::cerr << "Error: the " << (got == &ascii ? "ascii" : "2-bit") << " kernel gives length " << got->length << " at " << got->position << " rather than "
+								<< want.length << " at " << want.position << " (seed " << seed << " of " << read << ", position " << position << " of " << bases << ", record " << first << "-" << last << ")" << std::endl;
+						}
+				matched += want.length != 0;
+				}
+			}
+		}
+
+	std::cout << "Extension check: " << GENOMES * QUERIES * SEEDS << " seeds (" << matched << " verified), " << wrong << " disagreements" << std::endl;
+	DISAGREEMENTS += wrong;
+	}
+
+/*
+	CHECK_LOOKUPS()
+	---------------
+	Look up every k-mer of the genome, and a noisy copy of each (one base changed, so most are not in the genome), every way
+	there is, and check that each way gives exactly the hits of lookup_kmers() over the deserialised offsets layout:
+	interleaved, behind a prefilter, in the inline layout, and mapped (while it warms).  Then check that the shards (in this
+	process and in child processes) give back each k-mer's bucket, with the long buckets left in the index, moved to a
+	repeat table with their positions, and masked, and that lookups with the repeat table (once it has been written and read
+	back) give the hits they should.
+*/
+void check_lookups(char *genome, uint64_t genomeSize, const std::map<uint32_t, std::string> &referenceIDMap)
+	{
+	static const uint32_t REPEAT_THRESHOLD = 8;
+	static const size_t SHARDS = 4;
+
+	int numBitsToKeep = ::ceil(::log2(genomeSize));
+	uint32_t MASK = (numBitsToKeep == 32) ? UINT32_MAX : (1 << numBitsToKeep) - 1;
+	huge_page_vector<protected_vector<uint32_t>> kmersMap;
+	auto build = [&]()
+		{
+		huge_page_vector<protected_vector<uint32_t>>(pow(2, numBitsToKeep)).swap(kmersMap);
+		index_kmers(genome, genomeSize, kmersMap, MASK, 0, nullptr, MURMUR_HASH, &referenceIDMap);
+		};
+
+	std::vector<uint64_t> kmers;
+	for (uint64_t position = 0; position + 32 <= genomeSize; position++)
+		kmers.push_back(encode_kmer_2bit::pack_32mer(genome + position));
+	std::mt19937_64 random(GENOME.seed + 2);
+	for (size_t which = 0, genomeKmers = kmers.size(); which < genomeKmers; which++)
+		kmers.push_back(kmers[which] ^ ((random() % 3 + 1) << (2 * (random() % 32))));
+	std::vector<uint64_t> canonicalKmers(kmers.size());
+	for (size_t which = 0; which < kmers.size(); which++)
+		canonicalKmers[which] = kmers[which] ^ encode_kmer_2bit::reverse_complement_32mer(kmers[which]);
+
+	/*
+		The reference answer
+	*/
+	build();
+	std::string baseName = SCRATCH + "_check";
+	std::vector<std::string> files = write_index(kmersMap, genome, genomeSize, baseName, OFFSET_LAYOUT);
+	huge_page_vector<uint32_t> innerMapBlob;
+	huge_page_vector<uint32_t> outerMapBlob;
+	deserializeMap(files[0], files[1], innerMapBlob, outerMapBlob);
+	index_view view(innerMapBlob, outerMapBlob, genome, genomeSize);
+	std::vector<lookup_hit> expected;
+	lookup_kmers(view, kmers.data(), kmers.size(), expected);
+
+	std::vector<lookup_hit> found;
+	auto compare = [&](const std::string &how, const index_view &index, const std::vector<lookup_hit> &wanted)
+		{
+		for (size_t in_flight : {0, 8, 16, 32})
+			{
+			found.clear();
+			if (in_flight == 0)
+				lookup_kmers(index, kmers.data(), kmers.size(), found);
+			else
+				lookup_kmers_interleaved(index, kmers.data(), kmers.size(), found, in_flight);
+			std::string name = how + (in_flight == 0 ? "one at a time" : "interleaved " + std::to_string(in_flight));
+			if (uint64_t wrong = hit_differences(wanted, found))
+				disagree() << "lookup (" << name << ") differs from lookup_kmers() over the offsets layout in " << wrong << " of " << wanted.size() << " hits" << std::endl;
+			else
+				std::cout << "Lookup (" << name << "): " << found.size() << " hits of " << kmers.size() << " k-mers, as expected" << std::endl;
+			}
+		};
+
+	compare("offsets, ", view, expected);
+
+	blocked_bloom_filter prefilter(genomeSize, 10);
+	huge_page_vector<protected_vector<uint32_t>> noMap;
+	index_kmers(genome, genomeSize, noMap, MASK, 0, &prefilter, MURMUR_HASH, &referenceIDMap);
+	index_view filtered = view;
+	filtered.prefilter = &prefilter;
+	compare("offsets, prefiltered, ", filtered, expected);
+
+	std::vector<std::string> inlineFiles = write_index(kmersMap, genome, genomeSize, baseName + "_inline", INLINE_LAYOUT);
+	huge_page_vector<uint32_t> inlineInnerMapBlob;
+	huge_page_vector<uint32_t> inlineOuterMapBlob;
+	deserializeMap(inlineFiles[0], inlineFiles[1], inlineInnerMapBlob, inlineOuterMapBlob, INLINE_LAYOUT);
+	compare("inline, ", index_view(inlineInnerMapBlob, inlineOuterMapBlob, genome, genomeSize, MURMUR_HASH, INLINE_LAYOUT), expected);
+
+	check_mapped(baseName, files, OFFSET_LAYOUT, genome, genomeSize);
+	check_mapped(baseName + "_inline", inlineFiles, INLINE_LAYOUT, genome, genomeSize);
+
+	/*
+		The shards must give back each k-mer's bucket as it is in the single index, or as the repeat table has it
+	*/
+	auto check_shards = [&](const std::string &how, const repeat_table &repeats)
+		{
+		serializeShards(kmersMap, baseName, SHARDS);
+		for (bool separateProcesses : {false, true})
+			{
+			shard_router router(baseName, separateProcesses);
+			std::vector<std::vector<uint32_t>> postings;
+			std::vector<uint32_t> masked;
+			router.lookup(canonicalKmers, postings, &masked);
+
+			uint64_t wrong = 0;
+			std::vector<uint32_t> bucket;
+			for (size_t which = 0; which < canonicalKmers.size(); which++)
+				{
+				uint32_t hashed = kmerHash(MURMUR_HASH, canonicalKmers[which]) & MASK;
+				const repeat_bucket *entry = repeats.find(hashed);
+				const uint32_t *positions;
+				uint32_t scratch[2];
+				size_t count = bucket_positions(innerMapBlob.data(), innerMapBlob.size(), outerMapBlob.data(), outerMapBlob.size(), hashed, OFFSET_LAYOUT, positions, scratch);
+				bucket.clear();
+				if (entry == nullptr || entry->stored != 0)
+					bucket.assign(positions, positions + count);
+				std::sort(bucket.begin(), bucket.end());
+				std::sort(postings[which].begin(), postings[which].end());
+				wrong += postings[which] != bucket || masked[which] != (entry != nullptr && entry->stored == 0 ? entry->count : 0);
+				}
+
+			std::string name = how + (separateProcesses ? ", shard processes" : ", shards in this process");
+			if (wrong != 0)
+				disagree() << "the " << SHARDS << " shards (" << name << ") give the wrong bucket for " << wrong << " of " << canonicalKmers.size() << " k-mers" << std::endl;
+			else
+				std::cout << "Shards (" << name << "): " << canonicalKmers.size() << " k-mers, each with its bucket" << std::endl;
+			}
+		removeShards(baseName);
+		};
+
+	check_shards("no repeat table", repeat_table());
+
+	for (bool keepPositions : {true, false})
+		{
+		std::string how = keepPositions ? "repeat table" : "masked repeat table";
+
+		/*
+			The table must read back as it was written
+		*/
+		build();
+		repeat_table repeats;
+		repeats.extract(kmersMap, REPEAT_THRESHOLD, keepPositions);
+		repeats.serialize(repeatTableFilename(baseName));
+		repeat_table loaded;
+		bool same = loaded.deserialize(repeatTableFilename(baseName)) && loaded.positions == repeats.positions && loaded.entries.size() == repeats.entries.size();
+		for (size_t which = 0; same && which < repeats.entries.size(); which++)
+			{
+			const repeat_bucket &want = repeats.entries[which];
+			const repeat_bucket &got = loaded.entries[which];
+			same = want.bucket == got.bucket && want.count == got.count && want.offset == got.offset && want.stored == got.stored;
+			}
+		if (!same)
+			disagree() << "the " << how << " does not read back as it was written" << std::endl;
+		else
+			std::cout << "The " << how << " (" << repeats.entries.size() << " buckets of more than " << REPEAT_THRESHOLD << " positions) reads back as written" << std::endl;
+
+		/*
+			With the positions kept the hits must not change, masked buckets give a single hit with their count instead
+		*/
+		std::vector<lookup_hit> wanted;
+		for (const auto &hit : expected)
+			{
+			const repeat_bucket *entry = loaded.find(kmerHash(MURMUR_HASH, canonicalKmers[hit.query]) & MASK);
+			if (entry == nullptr || entry->stored != 0)
+				wanted.push_back(hit);
+			}
+		for (size_t which = 0; which < canonicalKmers.size(); which++)
+			{
+			const repeat_bucket *entry = loaded.find(kmerHash(MURMUR_HASH, canonicalKmers[which]) & MASK);
+			if (entry != nullptr && entry->stored == 0)
+				wanted.push_back(lookup_hit{static_cast<uint32_t>(which), 0, false, entry->count});
+			}
+
+		huge_page_vector<uint32_t> reducedInnerMapBlob;
+		huge_page_vector<uint32_t> reducedOuterMapBlob;
+		serializeMap(kmersMap, files[0], files[1]);
+		deserializeMap(files[0], files[1], reducedInnerMapBlob, reducedOuterMapBlob);
+		index_view reduced(reducedInnerMapBlob, reducedOuterMapBlob, genome, genomeSize);
+		reduced.repeats = &loaded;
+		compare("offsets, " + how + ", ", reduced, wanted);
+
+		check_shards(how, loaded);
+		remove(repeatTableFilename(baseName).c_str());
+		}
+
+	for (const auto &written : {files, inlineFiles})
+		for (const auto &file : written)
+			remove(file.c_str());
+	}
+
+/*
+	READ_FILE()
+	-----------
+	Read a whole file, returning false if it cannot be opened.
+*/
+bool read_file(const std::string &filename, std::string &contents)
+	{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		return false;
+	contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+	}
+
+/*
+	CHECK_APPEND()
+	--------------
+	With indexReference (INDEXER), index the FASTA in one go and then as its first records with the rest appended, and check
+	that both give the same index files, byte for byte.  The FASTA is split once so that the append rebuilds the index (the
+	first records need a hash bit fewer than the whole) and once so that it does not, and each is done without options, with
+	a prefilter, with a repeat table (positions kept and masked) and in the inline layout.  Last it is indexed sharded, which
+	has indexReference round trip the genome's k-mers through the shard processes (and fail if they differ).
+*/
+void check_append(const std::string &fasta)
+	{
+	const std::string options[] = {"", "-prefilter 10", "-repeats 8", "-repeats 8 -repeatMode mask", "-layout inline", "-layout inline -prefilter 10 -repeats 8"};
+	const std::string compared[] = {"_32_InnerBlob.idx", "_32_OuterBlob.idx", "_genome.idx", "_refID.idx", "_32_Metadata.idx", "_32_Prefilter.idx", "_32_Repeats.idx"};
+	std::string whole = SCRATCH + "_whole";
+	std::string first = SCRATCH + "_first";
+	std::string rest = SCRATCH + "_rest";
+
+	auto index = [](const std::string &arguments)
+		{
+		return system((INDEXER + " " + arguments + " > /dev/null").c_str()) == 0;
+		};
+
+	writeTextBlobToFile(fasta.c_str(), fasta.size(), whole + ".fasta");
+	for (double fraction : {0.4, 0.9})
+		{
+		size_t split = fasta.find('>', static_cast<size_t>(fasta.size() * fraction));
+		if (split == std::string::npos)
+			{
+			disagree() << "the FASTA has no record after " << fraction * 100 << "% of it to append" << std::endl;
+			continue;
+			}
+		writeTextBlobToFile(fasta.c_str(), split, first + ".fasta");
+		writeTextBlobToFile(fasta.c_str() + split, fasta.size() - split, rest + ".fasta");
+
+		for (const auto &option : options)
+			{
+			std::string how = "first " + std::to_string(split) + " of " + std::to_string(fasta.size()) + " bytes" + (option == "" ? "" : ", " + option);
+			if (!index("-reference " + whole + ".fasta " + option) || !index("-reference " + first + ".fasta " + option) || !index("-reference " + first + ".fasta -append " + rest + ".fasta"))
+				{
+				disagree() << INDEXER << " failed (" << how << ")" << std::endl;
+				continue;
+				}
+
+			uint64_t different = 0;
+			for (const auto &suffix : compared)
+				{
+				std::string appended;
+				std::string built;
+				bool have_appended = read_file(first + suffix, appended);
+				bool have_built = read_file(whole + suffix, built);
+				if (have_appended != have_built || appended != built)
+					{
+					disagree() << "appending (" << how << ") gives a different " << suffix << " from indexing the whole FASTA" << std::endl;
+					different++;
+					}
+				}
+			if (different == 0)
+				std::cout << "Append (" << how << "): the same index as indexing the whole FASTA" << std::endl;
+			}
+		}
+
+	for (const auto &option : {"-shards 4", "-shards 4 -repeats 8"})
+		if (!index("-reference " + whole + ".fasta " + option))
+			disagree() << INDEXER << " " << option << " failed (or its shard round trip did)" << std::endl;
+		else
+			std::cout << "Sharded (" << option << "): round trip through the shard processes as expected" << std::endl;
+
+	removeShards(whole);
+	for (const auto &base : {whole, first})
+		{
+		for (const auto &suffix : compared)
+			remove((base + suffix).c_str());
+		remove((base + "_fileID.idx").c_str());
+		remove((base + ".fasta").c_str());
+		}
+	remove((rest + ".fasta").c_str());
+	}
+
+/*
+	CHECK()
+	-------
+	Run the correctness checks on the FASTA (which is packed in place), returning the exit status.
+*/
+int check(std::string &fasta)
+	{
+	check_extension();
+
+	if (INDEXER != "")
+		check_append(fasta);
+	else
+		std::cout << "No -indexer given, appending and sharded indexing are not checked" << std::endl;
+
+	std::map<uint32_t, std::string> referenceIDMap;
+	uint64_t genomeSize = packGenome(&fasta[0], fasta.size(), referenceIDMap);
+	char *genome = &fasta[0];
+
+	std::vector<uint64_t> canonical;
+	for (uint64_t position = 0; position + 32 <= genomeSize; position++)
+		{
+		uint64_t kmer = encode_kmer_2bit::pack_32mer(genome + position);
+		canonical.push_back(kmer ^ encode_kmer_2bit::reverse_complement_32mer(kmer));
+		}
+	check_crc32c(canonical);
+
+	check_lookups(genome, genomeSize, referenceIDMap);
+
+	if (DISAGREEMENTS != 0)
+		std::cout << "Checks failed: " << DISAGREEMENTS << " disagreements" << std::endl;
+	else
+		std::cout << "Checks passed" << std::endl;
+
+	return DISAGREEMENTS == 0 ? 0 : 1;
+	}
+
+/*
+	WRITE_JSON()
+	------------
+*/
+void write_json(const std::string &filename, uint64_t genomeSize)
+	{
+	std::ofstream out(filename);
+	if (!out)
+		{
+		std::cerr << "Error opening the file: " << filename << std::endl;
+		return;
+		}
+
+	out << "{\n";
+	out << "  \"timestamp\": " << std::time(nullptr) << ",\n";
+	out << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+	out << "  \"hardware_concurrency\": " << std::thread::hardware_concurrency() << ",\n";
+	out << "  \"iterations\": " << ITERATIONS << ",\n";
+	out << "  \"genome\": {\"seed\": " << GENOME.seed << ", \"bases\": " << GENOME.bases << ", \"records\": " << GENOME.records << ", \"repeat_fraction\": " << GENOME.repeat_fraction
+		<< ", \"repeat_length\": " << GENOME.repeat_length << ", \"repeat_families\": " << GENOME.repeat_families << ", \"repeat_divergence\": " << GENOME.repeat_divergence
+		<< ", \"n_runs\": " << GENOME.n_runs << ", \"n_run_length\": " << GENOME.n_run_length << ", \"packed_bases\": " << genomeSize << "},\n";
+	out << "  \"results\": [\n";
+	for (size_t which = 0; which < results.size(); which++)
+		{
+		const auto &result = results[which];
+		out << "    {\"name\": \"" << result.name << "\", \"operations\": " << result.operations << ", \"seconds\": " << result.seconds
+			<< ", \"ops_per_sec\": " << result.operations / result.seconds << ", \"ns_per_op\": " << result.seconds * 1e9 / result.operations << "}" << (which + 1 == results.size() ? "\n" : ",\n");
+		}
+	out << "  ]\n";
+	out << "}\n";
+	}
+
+/*
+	INITIALISE()
+	------------
+*/
+void intialise(int argc, char *argv[])
+	{
+	if ((argc > 1) && strcmp(argv[1], "-help") == 0)
+		{
+		std::cout << "Usage:  " << argv[0] << " [-size <bases>] [-seed <n>] [-records <n>] [-repeatFraction <0..1>] [-repeatLength <bases>] [-repeatFamilies <n>]\n";
+		std::cout << "        " << "[-divergence <0..1>] [-nRuns <n>] [-nRunLength <bases>] [-iterations <n>] [-lookups <n>] [-json <filename>] [-fasta <filename>]\n";
+		std::cout << "        " << "[-hugePages yes|no|both] [-files <n>] [-check] [-indexer <indexReference>]\n";
+		std::cout << "-check runs the correctness checks rather than the benchmarks (the benchmarks check their results too), and fails if\n";
+		std::cout << "        " << "any does.  With -indexer it also checks appending to and sharding indexes built by that indexReference\n";
+		std::cout << "example:" << argv[0] << " -size 100000000 -seed 7 -json bench_results.json\n";
+		exit(0);
+		}
+
+	for (int i = 1; i < argc; i++)
+		{
+		std::string arg = argv[i];
+		if (arg == "-check")
+			{
+			CHECK = true;
+			continue;
+			}
+		if (i + 1 >= argc)
+			{
+			std::cout << "Error: Missing value for " << arg << " option." << std::endl;
+			continue;
+			}
+
+		std::string value = argv[++i];
+
+		if (arg == "-size")
+			GENOME.bases = std::stoull(value);
+		else if (arg == "-seed")
+			GENOME.seed = std::stoull(value);
+		else if (arg == "-records")
+			GENOME.records = std::stoul(value);
+		else if (arg == "-repeatFraction")
+			GENOME.repeat_fraction = std::stod(value);
+		else if (arg == "-repeatLength")
+			GENOME.repeat_length = std::stoul(value);
+		else if (arg == "-repeatFamilies")
+			GENOME.repeat_families = std::stoul(value);
+		else if (arg == "-divergence")
+			GENOME.repeat_divergence = std::stod(value);
+		else if (arg == "-nRuns")
+			GENOME.n_runs = std::stoul(value);
+		else if (arg == "-nRunLength")
+			GENOME.n_run_length = std::stoul(value);
+		else if (arg == "-iterations")
+			ITERATIONS = std::max(1, std::stoi(value));
+		else if (arg == "-lookups")
+			LOOKUPS = std::stoull(value);
+		else if (arg == "-json")
+			JSON_FILENAME = value;
+		else if (arg == "-fasta")
+			FASTA_FILENAME = value;
+		else if (arg == "-hugePages")
+			HUGE_PAGES = value;
+		else if (arg == "-files")
+			FILES = std::stoul(value);
+		else if (arg == "-indexer")
+			INDEXER = value;
+		else
+			std::cerr << "Error: Unknown option: " << arg << std::endl;
+		}
+	}
+
+/*
+	MAIN()
+	------
+*/
+int main(int argc, char *argv[])
+	{
+	intialise(argc, argv);
+	if (CHECK)
+		GENOME.records = std::max<uint32_t>(GENOME.records, 16);		// the append check splits the FASTA between records
+
+	/*
+		Generate the genome
+	*/
+	std::cout << "Generating " << GENOME.bases << " bases (seed " << GENOME.seed << ")" << std::endl;
+	std::string fasta = generate_synthetic_genome(GENOME);
+	if (FASTA_FILENAME != "")
+		writeTextBlobToFile(fasta.c_str(), fasta.size(), FASTA_FILENAME);
+	if (CHECK)
+		return check(fasta);
+
+	bench_packGenome(fasta);
+	bench_load(fasta);
+
+	/*
+		Pack the genome where the FASTA is (packing only ever shortens it) rather than in a copy
+	*/
+	std::map<uint32_t, std::string> referenceIDMap;
+	uint64_t genomeSize = packGenome(&fasta[0], fasta.size(), referenceIDMap);
+	char *genome = &fasta[0];
+	if (genomeSize < 64)
+		{
+		std::cerr << "The genome is too small to benchmark" << std::endl;
+		return 1;
+		}
+
+	/*
+		Run the benchmarks
+	*/
+	bench_encoding(genome, genomeSize);
+	bench_hashing(genome, genomeSize);
+	bench_extension(genome, genomeSize, referenceIDMap);
+	bench_protected_vector(genomeSize);
+	if (HUGE_PAGES != "yes")
+		{
+		huge_pages::enabled = false;
+		bench_index(genome, genomeSize, referenceIDMap, HUGE_PAGES == "both" ? "/hugepages_off" : "");
+		}
+	if (HUGE_PAGES != "no")
+		{
+		huge_pages::enabled = true;
+		bench_index(genome, genomeSize, referenceIDMap, HUGE_PAGES == "both" ? "/hugepages_on" : "");
+		}
+	bench_open(genome, genomeSize, referenceIDMap);
+
+	write_json(JSON_FILENAME, genomeSize);
+	std::cout << "Results written to " << JSON_FILENAME << std::endl;
+
+	if (DISAGREEMENTS != 0)
+		{
+		std::cerr << DISAGREEMENTS << " correctness checks failed" << std::endl;
+		return 1;
+		}
+
+	return 0;
+	}
@@ -0,0 +1,102 @@
+/*
+	BLOCKEDBLOOMFILTER.CPP
+	----------------------
+	indexReference
+
+	A cache-blocked (split block) Bloom filter over the canonical k-mers of the reference.
+*/
+#include <string.h>
+
+#include <fstream>
+
+#include "blockedBloomFilter.hpp"
+
+constexpr uint32_t blocked_bloom_filter::salt[];
+
+/*
+	BLOCKED_BLOOM_FILTER::BLOCKED_BLOOM_FILTER()
+	--------------------------------------------
+*/
+blocked_bloom_filter::blocked_bloom_filter(uint64_t expected_keys, uint32_t bits_per_key) :
+	blocks(nullptr),
+	block_count(0)
+	{
+	uint64_t bits = expected_keys * bits_per_key;
+	allocate((bits + 511) / 512);
+	}
+
+/*
+	BLOCKED_BLOOM_FILTER::~BLOCKED_BLOOM_FILTER()
+	---------------------------------------------
+*/
+blocked_bloom_filter::~blocked_bloom_filter()
+	{
+	free(blocks);
+	}
+
+/*
+	BLOCKED_BLOOM_FILTER::ALLOCATE()
+	--------------------------------
+	Allocate (and clear) a cache-line aligned filter of at least one block.
+*/
+void blocked_bloom_filter::allocate(uint64_t blocks_needed)
+	{
+	free(blocks);
+	block_count = blocks_needed == 0 ? 1 : blocks_needed;
+
+	void *memory = nullptr;
+	if (posix_memalign(&memory, 64, size_in_bytes()) != 0)
+		memory = nullptr;
+	blocks = static_cast<uint64_t *>(memory);
+	if (blocks != nullptr)
+		memset(blocks, 0, size_in_bytes());
+	else
+		block_count = 0;
+	}
+
+/*
+	BLOCKED_BLOOM_FILTER::FILL_RATIO()
+	----------------------------------
+	The proportion of bits set, the false positive rate is roughly this to the power of 8.
+*/
+double blocked_bloom_filter::fill_ratio(void) const
+	{
+	uint64_t set = 0;
+	for (uint64_t word = 0; word < block_count * WORDS_PER_BLOCK; word++)
+		set += __builtin_popcountll(blocks[word]);
+
+	return block_count == 0 ? 0 : static_cast<double>(set) / (size_in_bytes() * 8);
+	}
+
+/*
+	BLOCKED_BLOOM_FILTER::SERIALIZE()
+	---------------------------------
+	The block count followed by the blocks.
+*/
+bool blocked_bloom_filter::serialize(const std::string &filename) const
+	{
+	std::ofstream outputFile(filename, std::ios::binary);
+	if (!outputFile.is_open())
+		return false;
+
+	outputFile.write(reinterpret_cast<const char *>(&block_count), sizeof(block_count));
+	outputFile.write(reinterpret_cast<const char *>(blocks), size_in_bytes());
+
+	return outputFile.good();
+	}
+
+/*
+	BLOCKED_BLOOM_FILTER::DESERIALIZE()
+	-----------------------------------
+*/
+bool blocked_bloom_filter::deserialize(const std::string &filename)
+	{
+	std::ifstream inputFile(filename, std::ios::binary);
+	uint64_t blocks_needed;
+
+	if (!inputFile.read(reinterpret_cast<char *>(&blocks_needed), sizeof(blocks_needed)))
+		return false;
+
+	allocate(blocks_needed);
+	return blocks != nullptr && inputFile.read(reinterpret_cast<char *>(blocks), size_in_bytes());
+	}
@@ -9,6 +9,7 @@
 	The translation table for converign ascii into bits and bits into ascii
 */
 uint64_t encode_kmer_2bit::kmer_encoding_table[256];
+uint64_t encode_kmer_2bit::base_validity_table[256];
 
 namespace encode_kmer_2bit_init
 	{
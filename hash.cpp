@@ -8,27 +8,52 @@
 
 #include "hash.hpp"
 
+static const char *hash_function_names[HASH_FUNCTION_COUNT] = {"murmur", "xor", "multiplyShift", "crc32c", "wyhash"};
+
+#if defined(__x86_64__) && !defined(__SSE4_2__)
+	/*
+		__builtin_cpu_init() must be called before __builtin_cpu_supports() if (as here) it runs before the constructors
+	*/
+	const bool crc32c_sse42_available = (__builtin_cpu_init(), __builtin_cpu_supports("sse4.2"));
+#endif
+
 /*
-    MURMURHASH3()
-    -------------
+    HASH_FUNCTION_NAME()
+    --------------------
  */
-uint32_t murmurHash3(uint64_t key)
+const char *hash_function_name(hash_function which)
+	{
+	return which < HASH_FUNCTION_COUNT ? hash_function_names[which] : "unknown";
+	}
+
+/*
+    HASH_FUNCTION_FROM_NAME()
+	-------------------------
+*/
+bool hash_function_from_name(const std::string &name, hash_function &which)
 	{
-	// hash a 64bit value to 32 bits.
-	key ^= key >> 33;
-	key *= 0xff51afd7ed558ccdULL;
-	key ^= key >> 33;
-	key *= 0xc4ceb9fe1a85ec53ULL;
-	key ^= key >> 33;
-	return static_cast<uint32_t>(key);
+	for (int function = 0; function < HASH_FUNCTION_COUNT; function++)
+		if (name == hash_function_names[function])
+			{
+			which = static_cast<hash_function>(function);
+			return true;
+			}
+
+	return false;
 	}
 
 /*
-    XOR_HASH()
-	----------
+    CRC32C_IN_HARDWARE()
+	--------------------
+	true if crc32c_hash uses the CRC32 instruction on this CPU, false if it is the (slow) bit at a time fallback.
 */
-uint32_t xorHash(uint64_t packedKmer)
+bool crc32c_in_hardware(void)
 	{
-	uint32_t hash = static_cast<uint32_t>(packedKmer >> 32) ^ static_cast<uint32_t>(packedKmer);
-	return hash;
+#if defined(__SSE4_2__) || defined(__ARM_FEATURE_CRC32)
+	return true;
+#elif defined(__x86_64__)
+	return crc32c_sse42_available;
+#else
+	return false;
+#endif
 	}
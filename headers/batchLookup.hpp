@@ -0,0 +1,113 @@
+/*
+	BATCHLOOKUP.HPP
+	---------------
+	indexReference
+
+	Look up (and verify against the genome) k-mers in a deserialised index, either one at a time or many at once with their
+	memory accesses interleaved (asynchronous memory access chaining, AMAC) so that several cache misses are in flight at once.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "hash.hpp"
+#include "hugePages.hpp"
+#include "bucketLayout.hpp"
+#include "repeatBuckets.hpp"
+#include "blockedBloomFilter.hpp"
+
+/*
+	CLASS INDEX_VIEW
+	----------------
+*/
+/*!
+	@brief A read-only view of an index (the Outer and Inner blobs and the genome) wherever it is held in memory
+*/
+class index_view
+	{
+	public:
+		const uint32_t *outer;			// the OuterBlob (as uint32_t words whatever the layout)
+		uint64_t outer_size;
+		const uint32_t *inner;			// the InnerBlob
+		uint64_t inner_size;
+		const char *genome;				// the packed genome (one byte per base)
+		uint64_t genome_size;
+		uint32_t MASK;						// bucket = hash(canonical) & MASK
+		hash_function hash;				// the hash the index was built with (from its index_metadata)
+		bucket_layout layout;			// how the buckets are held in the blobs (from its index_metadata)
+		const blocked_bloom_filter *prefilter;	// if not nullptr, k-mers it rejects are not looked up (the _32_Prefilter.idx of the index)
+		const repeat_table *repeats;				// if not nullptr, the buckets moved out of the blobs (the _32_Repeats.idx of the index)
+
+	public:
+		index_view() :
+			outer(nullptr),
+			outer_size(0),
+			inner(nullptr),
+			inner_size(0),
+			genome(nullptr),
+			genome_size(0),
+			MASK(0),
+			hash(MURMUR_HASH),
+			layout(OFFSET_LAYOUT),
+			prefilter(nullptr),
+			repeats(nullptr)
+			{
+			/* Nothing */
+			}
+
+		index_view(const huge_page_vector<uint32_t> &innerMapBlob, const huge_page_vector<uint32_t> &outerMapBlob, const char *genome, uint64_t genome_size, hash_function hash = MURMUR_HASH, bucket_layout layout = OFFSET_LAYOUT, const blocked_bloom_filter *prefilter = nullptr, const repeat_table *repeats = nullptr) :
+			outer(outerMapBlob.data()),
+			outer_size(outerMapBlob.size()),
+			inner(innerMapBlob.data()),
+			inner_size(innerMapBlob.size()),
+			genome(genome),
+			genome_size(genome_size),
+			MASK(static_cast<uint32_t>(bucket_count(outerMapBlob.size(), layout) - 1)),
+			hash(hash),
+			layout(layout),
+			prefilter(prefilter),
+			repeats(repeats)
+			{
+			/* Nothing */
+			}
+	};
+
+/*
+	CLASS LOOKUP_HIT
+	----------------
+*/
+/*!
+	@brief A verified occurrence of a query k-mer in the genome or, if masked is not 0, a query whose bucket is a repeat bucket
+	kept only as a count (masked positions, none of them verified).
+*/
+class lookup_hit
+	{
+	public:
+		uint32_t query;		// index of the query in the batch
+		uint32_t position;	// where in the genome the k-mer starts
+		bool reverse;			// true if the genome holds the reverse complement of the query
+		uint32_t masked;		// 0, or the number of positions in the masked repeat bucket (position and reverse are then 0)
+	};
+
+/*!
+	@brief Look up each k-mer in turn: check the prefilter (if any), hash, read the bucket (from the repeat table if it was
+	moved there), then verify each position against the genome.
+	@param index [in] The index.
+	@param kmers [in] The query k-mers (packed 2 bits per base, as from encode_kmer_2bit::pack_32mer()).
+	@param count [in] The number of k-mers.
+	@param hits [out] The verified hits are appended to this.
+*/
+void lookup_kmers(const index_view &index, const uint64_t *kmers, size_t count, std::vector<lookup_hit> &hits);
+
+/*!
+	@brief Look up k-mers keeping in_flight lookups going at once.  Gives the same hits as lookup_kmers(), but in the order
+	they complete, not query order.
+	@param index [in] The index.
+	@param kmers [in] The query k-mers (packed 2 bits per base).
+	@param count [in] The number of k-mers.
+	@param hits [out] The verified hits are appended to this.
+	@param in_flight [in] The number of interleaved lookups (8 to 32 is usually best).
+*/
+void lookup_kmers_interleaved(const index_view &index, const uint64_t *kmers, size_t count, std::vector<lookup_hit> &hits, size_t in_flight = 16);
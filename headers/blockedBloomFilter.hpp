@@ -0,0 +1,142 @@
+/*
+	BLOCKEDBLOOMFILTER.HPP
+	----------------------
+	indexReference
+
+	A cache-blocked (split block) Bloom filter over the canonical k-mers of the reference, used to reject absent k-mers
+	before touching the index.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <string>
+
+/*
+	CLASS BLOCKED_BLOOM_FILTER
+	--------------------------
+*/
+/*!
+	@brief A Bloom filter where each key sets (and each lookup tests) one bit in each of the 8 words of a single 64-byte block,
+	so a lookup is exactly one cache line.
+*/
+class blocked_bloom_filter
+	{
+	private:
+		static const size_t WORDS_PER_BLOCK = 8;
+
+		/*
+			Odd multipliers used to pick the bit within each word (from the Parquet / Impala split block Bloom filter)
+		*/
+		static constexpr uint32_t salt[WORDS_PER_BLOCK] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU, 0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+		uint64_t *blocks;			// the filter, 64-byte aligned
+		uint64_t block_count;
+
+	private:
+		/*
+			BLOCKED_BLOOM_FILTER::HASH()
+			----------------------------
+			The splitmix64 finaliser, independent of the bucket hash.
+		*/
+		static uint64_t hash(uint64_t key)
+			{
+			key ^= key >> 30;
+			key *= 0xbf58476d1ce4e5b9ULL;
+			key ^= key >> 27;
+			key *= 0x94d049bb133111ebULL;
+			key ^= key >> 31;
+			return key;
+			}
+
+		/*
+			BLOCKED_BLOOM_FILTER::BLOCK_OF()
+			--------------------------------
+			Map the top 32 bits of the hash onto [0, block_count) without a divide.
+		*/
+		uint64_t *block_of(uint64_t hashed) const
+			{
+			return blocks + ((hashed >> 32) * block_count >> 32) * WORDS_PER_BLOCK;
+			}
+
+		void allocate(uint64_t blocks_needed);
+
+	public:
+		/*!
+			@brief Constructor
+			@param expected_keys [in] The number of keys that will be inserted.
+			@param bits_per_key [in] The filter size in bits per key (10 gives roughly a 1% false positive rate).
+		*/
+		blocked_bloom_filter(uint64_t expected_keys = 0, uint32_t bits_per_key = 10);
+		~blocked_bloom_filter();
+
+		blocked_bloom_filter(const blocked_bloom_filter &) = delete;
+		blocked_bloom_filter &operator=(const blocked_bloom_filter &) = delete;
+
+		/*
+			BLOCKED_BLOOM_FILTER::INSERT()
+			------------------------------
+		*/
+		/*!
+			@brief Add a canonical k-mer to the filter.  Safe to call from several threads at once.
+			@param canonical [in] The canonical k-mer.
+		*/
+		void insert(uint64_t canonical)
+			{
+			uint64_t hashed = hash(canonical);
+			uint64_t *block = block_of(hashed);
+			uint32_t low = static_cast<uint32_t>(hashed);
+
+			for (size_t word = 0; word < WORDS_PER_BLOCK; word++)
+				__atomic_fetch_or(block + word, 1ULL << ((low * salt[word]) >> 26), __ATOMIC_RELAXED);
+			}
+
+		/*
+			BLOCKED_BLOOM_FILTER::POSSIBLY_CONTAINS()
+			-----------------------------------------
+		*/
+		/*!
+			@brief Test whether a canonical k-mer might be in the reference.
+			@param canonical [in] The canonical k-mer.
+			@returns false if the k-mer is certainly absent, true if it is probably present.
+		*/
+		bool possibly_contains(uint64_t canonical) const
+			{
+			uint64_t hashed = hash(canonical);
+			const uint64_t *block = block_of(hashed);
+			uint32_t low = static_cast<uint32_t>(hashed);
+			uint64_t missing = 0;
+
+			for (size_t word = 0; word < WORDS_PER_BLOCK; word++)
+				missing |= ~block[word] & (1ULL << ((low * salt[word]) >> 26));
+
+			return missing == 0;
+			}
+
+		/*
+			BLOCKED_BLOOM_FILTER::PREFETCH()
+			--------------------------------
+		*/
+		/*!
+			@brief Start loading the block that possibly_contains() will read for this k-mer.
+			@param canonical [in] The canonical k-mer.
+		*/
+		void prefetch(uint64_t canonical) const
+			{
+			__builtin_prefetch(block_of(hash(canonical)));
+			}
+
+		/*
+			BLOCKED_BLOOM_FILTER::SIZE_IN_BYTES()
+			-------------------------------------
+		*/
+		uint64_t size_in_bytes(void) const
+			{
+			return block_count * WORDS_PER_BLOCK * sizeof(uint64_t);
+			}
+
+		double fill_ratio(void) const;
+		bool serialize(const std::string &filename) const;
+		bool deserialize(const std::string &filename);
+	};
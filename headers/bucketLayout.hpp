@@ -0,0 +1,150 @@
+/*
+	BUCKETLAYOUT.HPP
+	----------------
+	indexReference
+
+	The two ways the buckets of an index can be laid out in the Outer and Inner blobs.
+
+	OFFSET_LAYOUT: the OuterBlob holds a uint32_t offset per bucket into the InnerBlob, where each non-empty bucket's sorted
+	positions are followed by a UINT32_MAX sentinal.  A lookup reads the OuterBlob then the InnerBlob.
+
+	INLINE_LAYOUT: the OuterBlob holds a uint64_t per bucket with a tag in its top 2 bits.  A bucket of one position, or of two
+	positions both below 2^31, is held in the entry itself so a lookup is a single read.  Only larger buckets spill to the
+	InnerBlob, as an offset and a count (so without a sentinal).
+*/
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+enum bucket_layout {OFFSET_LAYOUT, INLINE_LAYOUT};
+
+/*
+	CLASS INLINE_BUCKET
+	-------------------
+*/
+/*!
+	@brief Encode and decode the tagged OuterBlob entries of INLINE_LAYOUT
+*/
+class inline_bucket
+	{
+	public:
+		enum tag {EMPTY = 0, SINGLE = 1, DOUBLE = 2, SPILL = 3};
+
+		static const uint32_t LARGEST_DOUBLE = 0x7fffffff;		// both positions of a DOUBLE must be no larger than this
+		static const uint32_t LARGEST_SPILL = 0x3fffffff;		// the most positions a SPILL entry can count
+
+	public:
+		static inline uint64_t empty(void)
+			{
+			return 0;
+			}
+
+		static inline uint64_t single(uint32_t position)
+			{
+			return (static_cast<uint64_t>(SINGLE) << 62) | position;
+			}
+
+		static inline uint64_t pair(uint32_t first, uint32_t second)
+			{
+			return (static_cast<uint64_t>(DOUBLE) << 62) | (static_cast<uint64_t>(second) << 31) | first;
+			}
+
+		static inline uint64_t spill(uint32_t offset, uint32_t count)
+			{
+			return (static_cast<uint64_t>(SPILL) << 62) | (static_cast<uint64_t>(count) << 32) | offset;
+			}
+
+		/*
+			INLINE_BUCKET::ENTRY()
+			----------------------
+			The entry of bucket in an OuterBlob held as uint32_t words (the blob is read and written as such whatever its layout).
+		*/
+		static inline uint64_t entry(const uint32_t *outer, uint64_t bucket)
+			{
+			uint64_t value;
+			memcpy(&value, outer + 2 * bucket, sizeof(value));
+			return value;
+			}
+
+		/*
+			INLINE_BUCKET::DECODE()
+			-----------------------
+			The positions held by an entry.  Inline positions are written to scratch, spilled ones are left in inner.
+		*/
+		static inline size_t decode(uint64_t value, const uint32_t *inner, const uint32_t *&positions, uint32_t scratch[2])
+			{
+			switch (value >> 62)
+				{
+				case SINGLE:
+					scratch[0] = static_cast<uint32_t>(value);
+					positions = scratch;
+					return 1;
+				case DOUBLE:
+					scratch[0] = static_cast<uint32_t>(value) & LARGEST_DOUBLE;
+					scratch[1] = static_cast<uint32_t>(value >> 31) & LARGEST_DOUBLE;
+					positions = scratch;
+					return 2;
+				case SPILL:
+					positions = inner + static_cast<uint32_t>(value);
+					return static_cast<size_t>((value >> 32) & LARGEST_SPILL);
+				default:
+					positions = scratch;
+					return 0;
+				}
+			}
+	};
+
+/*
+	BUCKET_COUNT()
+	--------------
+	The number of buckets given the size of the OuterBlob in uint32_t words.
+*/
+inline uint64_t bucket_count(uint64_t outer_size, bucket_layout layout)
+	{
+	return layout == INLINE_LAYOUT ? outer_size / 2 : outer_size;
+	}
+
+/*
+	BUCKET_POSITIONS()
+	------------------
+	The (sorted) positions in bucket, without a sentinal.  positions points into inner or, for an inline bucket, to scratch.
+*/
+inline size_t bucket_positions(const uint32_t *inner, uint64_t inner_size, const uint32_t *outer, uint64_t outer_size, uint64_t bucket, bucket_layout layout, const uint32_t *&positions, uint32_t scratch[2])
+	{
+	if (layout == INLINE_LAYOUT)
+		return inline_bucket::decode(inline_bucket::entry(outer, bucket), inner, positions, scratch);
+
+	uint64_t start = outer[bucket];
+	uint64_t end = bucket + 1 < outer_size ? outer[bucket + 1] : inner_size;
+	positions = inner + start;
+	return end == start ? 0 : end - start - 1;
+	}
+
+/*
+	BUCKET_LAYOUT_NAME()
+	--------------------
+	The name used on the command line and in the index metadata.
+*/
+inline const char *bucket_layout_name(bucket_layout layout)
+	{
+	return layout == INLINE_LAYOUT ? "inline" : "offsets";
+	}
+
+/*
+	BUCKET_LAYOUT_FROM_NAME()
+	-------------------------
+*/
+inline bool bucket_layout_from_name(const std::string &name, bucket_layout &layout)
+	{
+	if (name == "inline")
+		layout = INLINE_LAYOUT;
+	else if (name == "offsets")
+		layout = OFFSET_LAYOUT;
+	else
+		return false;
+
+	return true;
+	}
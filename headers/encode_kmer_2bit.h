@@ -30,6 +30,11 @@ class encode_kmer_2bit
 		*/
 		static uint64_t kmer_encoding_table[256];
 
+		/*
+			1 for A, C, G, T (either case), 0 for anything else (N, the other IUPAC codes, ...)
+		*/
+		static uint64_t base_validity_table[256];
+
 	public:
 		/*
 			ENCODE_KMER_2BIT::ENCODE_KMER_2BIT()
@@ -50,6 +55,9 @@ class encode_kmer_2bit
 			kmer_encoding_table[(size_t)'g'] = 2;
 			kmer_encoding_table[(size_t)'t'] = 3;
 
+			base_validity_table[(size_t)'A'] = base_validity_table[(size_t)'C'] = base_validity_table[(size_t)'G'] = base_validity_table[(size_t)'T'] = 1;
+			base_validity_table[(size_t)'a'] = base_validity_table[(size_t)'c'] = base_validity_table[(size_t)'g'] = base_validity_table[(size_t)'t'] = 1;
+
 			kmer_encoding_table[0] = 'A';
 			kmer_encoding_table[1] = 'C';
 			kmer_encoding_table[2] = 'G';
@@ -70,6 +78,20 @@ class encode_kmer_2bit
 			return kmer_encoding_table[(size_t)base];
 			}
 
+		/*
+			ENCODE_KMER_2BIT::IS_BASE()
+			---------------------------
+		*/
+		/*!
+			@brief Is the character one of the four bases (pack_1mer() maps anything else, such as N, to A).
+			@param base [in] The character to check.
+			@returns 1 if it is A, C, G or T (in either case), otherwise 0.
+		*/
+		static uint64_t is_base(char base)
+			{
+			return base_validity_table[(unsigned char)base];
+			}
+
 		/*
 			ENCODE_KMER_2BIT::PACK_20MER()
 			------------------------------
@@ -4,11 +4,198 @@
 	indexKISS
 
 	Created by Shlomo Geva on 13/7/2023.
+
+	The bucket hash policies.  The bucket of a canonical k-mer is hash(canonical) & MASK, so each policy must mix the key
+	into the low bits.  They are classes with a static inline hash() so that the indexer and the lookups can be instantiated
+	for each (see HASH_DISPATCH) and the hash inlined into their inner loops.
 */
 #pragma once
 
 #include <stdio.h>
 #include <stdint.h>
 
-uint32_t murmurHash3(uint64_t key);
-uint32_t xorHash(uint64_t packedKmer);
+#include <string>
+
+#if defined(__x86_64__)
+	#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+	#include <arm_acle.h>
+#endif
+
+/*
+	The policies, in the order they are listed by the hash report.  The names are those written to the index metadata.
+*/
+enum hash_function {MURMUR_HASH, XOR_FOLD_HASH, MULTIPLY_SHIFT_HASH, CRC32C_HASH, WYHASH_MIX_HASH, HASH_FUNCTION_COUNT};
+
+/*
+	CLASS MURMUR_HASH
+	-----------------
+	The MurmurHash3 64-bit finaliser.
+*/
+class murmur_hash
+	{
+	public:
+		static inline uint32_t hash(uint64_t key)
+			{
+			key ^= key >> 33;
+			key *= 0xff51afd7ed558ccdULL;
+			key ^= key >> 33;
+			key *= 0xc4ceb9fe1a85ec53ULL;
+			key ^= key >> 33;
+			return static_cast<uint32_t>(key);
+			}
+	};
+
+/*
+	CLASS XOR_FOLD_HASH
+	-------------------
+	The top half xored into the bottom half.  Cheapest, but the low bits only see 16 of the 32 bases.
+*/
+class xor_fold_hash
+	{
+	public:
+		static inline uint32_t hash(uint64_t key)
+			{
+			return static_cast<uint32_t>(key >> 32) ^ static_cast<uint32_t>(key);
+			}
+	};
+
+/*
+	CLASS MULTIPLY_SHIFT_HASH
+	-------------------------
+	Fibonacci hashing: the key times 2^64 / phi, with the high half of the product folded into the low half.  The low bits of
+	a product only depend on the low bits of the key, and the bucket is taken from the low bits, so without the fold the
+	bucket would not see the high bases at all.
+*/
+class multiply_shift_hash
+	{
+	public:
+		static inline uint32_t hash(uint64_t key)
+			{
+			uint64_t product = key * 0x9e3779b97f4a7c15ULL;
+			return static_cast<uint32_t>(product ^ (product >> 32));
+			}
+	};
+
+/*
+	CRC32C_SSE42_AVAILABLE
+	----------------------
+	true if this x86-64 CPU has the SSE4.2 CRC32 instruction (set before main() runs, see hash.cpp).
+*/
+#if defined(__x86_64__) && !defined(__SSE4_2__)
+	extern const bool crc32c_sse42_available;
+#endif
+
+/*
+	CLASS CRC32C_HASH
+	-----------------
+	The CRC32C of the 8 bytes of the key.  Builds for ARMv8 (with CRC) or for SSE4.2 use the CRC32 instruction directly.
+	Other x86-64 builds compile only sse42() for SSE4.2 and call it if the CPU has it, so the program still runs on a CPU
+	without it.  Everything else uses the bit at a time software CRC.
+*/
+class crc32c_hash
+	{
+	public:
+#if defined(__x86_64__)
+		/*
+			CRC32C_HASH::SSE42()
+			--------------------
+		*/
+		__attribute__((target("sse4.2"))) static inline uint32_t sse42(uint64_t key)
+			{
+			return static_cast<uint32_t>(_mm_crc32_u64(0, key));
+			}
+#endif
+
+		/*
+			CRC32C_HASH::SOFTWARE()
+			-----------------------
+		*/
+		static inline uint32_t software(uint64_t key)
+			{
+			uint32_t crc = 0;
+			for (int bit = 0; bit < 64; bit++)
+				crc = (crc >> 1) ^ (0x82f63b78 & -((crc ^ static_cast<uint32_t>(key >> bit)) & 1));
+			return crc;
+			}
+
+		/*
+			CRC32C_HASH::HASH()
+			-------------------
+		*/
+		static inline uint32_t hash(uint64_t key)
+			{
+#if defined(__SSE4_2__)
+			return sse42(key);
+#elif defined(__x86_64__)
+			return crc32c_sse42_available ? sse42(key) : software(key);
+#elif defined(__ARM_FEATURE_CRC32)
+			return __crc32cd(0, key);
+#else
+			return software(key);
+#endif
+			}
+	};
+
+/*
+	CLASS WYHASH_MIX_HASH
+	---------------------
+	The wyhash mix: the 128-bit product of the salted key and a second constant, high half xored into the low half.
+*/
+class wyhash_mix_hash
+	{
+	public:
+		static inline uint32_t hash(uint64_t key)
+			{
+			__uint128_t product = static_cast<__uint128_t>(key ^ 0xa0761d6478bd642fULL) * 0xe7037ed1a0b428dbULL;
+			return static_cast<uint32_t>(static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64));
+			}
+	};
+
+/*
+	HASH_DISPATCH()
+	---------------
+	The instantiation of FUNCTION (a function template taking the hash policy as its template parameter) for which.
+*/
+#define HASH_DISPATCH(which, FUNCTION) \
+	((which) == XOR_FOLD_HASH ? FUNCTION<xor_fold_hash> : \
+	(which) == MULTIPLY_SHIFT_HASH ? FUNCTION<multiply_shift_hash> : \
+	(which) == CRC32C_HASH ? FUNCTION<crc32c_hash> : \
+	(which) == WYHASH_MIX_HASH ? FUNCTION<wyhash_mix_hash> : \
+	FUNCTION<murmur_hash>)
+
+/*
+	KMERHASH()
+	----------
+	The hash of key with the policy chosen at run time, for use outside the inner loops.
+*/
+inline uint32_t kmerHash(hash_function which, uint64_t key)
+	{
+	switch (which)
+		{
+		case XOR_FOLD_HASH:
+			return xor_fold_hash::hash(key);
+		case MULTIPLY_SHIFT_HASH:
+			return multiply_shift_hash::hash(key);
+		case CRC32C_HASH:
+			return crc32c_hash::hash(key);
+		case WYHASH_MIX_HASH:
+			return wyhash_mix_hash::hash(key);
+		default:
+			return murmur_hash::hash(key);
+		}
+	}
+
+inline uint32_t murmurHash3(uint64_t key)
+	{
+	return murmur_hash::hash(key);
+	}
+
+inline uint32_t xorHash(uint64_t packedKmer)
+	{
+	return xor_fold_hash::hash(packedKmer);
+	}
+
+const char *hash_function_name(hash_function which);
+bool hash_function_from_name(const std::string &name, hash_function &which);
+bool crc32c_in_hardware(void);
@@ -0,0 +1,121 @@
+/*
+	HUGEPAGES.HPP
+	-------------
+	indexReference
+
+	Allocate the large, randomly accessed structures (the kmersMap buckets, the genome, the Outer and Inner blobs) on huge
+	pages to cut TLB misses.  1GB then 2MB hugetlbfs pages are tried first, then transparent huge pages (madvise), then
+	ordinary pages.
+*/
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <new>
+#include <limits>
+#include <vector>
+#include <iostream>
+
+/*
+	CLASS HUGE_PAGES
+	----------------
+*/
+class huge_pages
+	{
+	public:
+		enum backing {NONE, TRANSPARENT, HUGETLB_2MB, HUGETLB_1GB};
+
+		static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+		/*
+			If false, allocate() uses ordinary pages (for comparison)
+		*/
+		static bool enabled;
+
+	public:
+		/*!
+			@brief Allocate memory, on huge pages if it is large enough to make a difference (and they are available).
+			@param bytes [in] The size of the allocation.
+			@returns The memory (not initialised), or nullptr on failure.
+		*/
+		static void *allocate(size_t bytes);
+
+		/*!
+			@brief Free memory from allocate()
+			@param memory [in] The memory to free (nullptr is ignored).
+		*/
+		static void release(void *memory);
+
+		/*!
+			@brief Print, for each live allocation of at least one huge page, how much of it is actually backed by huge pages.
+			@param out [in] Where to write the report.
+		*/
+		static void report(std::ostream &out);
+
+		/*!
+			@brief The number of bytes of live allocations, and how many of them are on huge pages
+			@param allocated [out] Bytes allocated through allocate() that are large enough to be huge page candidates.
+			@param huge [out] Bytes of those actually on huge pages.
+		*/
+		static void coverage(uint64_t &allocated, uint64_t &huge);
+	};
+
+/*
+	CLASS HUGE_PAGE_ALLOCATOR
+	-------------------------
+*/
+/*!
+	@brief A standard library allocator using huge_pages::allocate()
+*/
+template <typename T>
+class huge_page_allocator
+	{
+	public:
+		typedef T value_type;
+
+	public:
+		huge_page_allocator()
+			{
+			/* Nothing */
+			}
+
+		template <typename U>
+		huge_page_allocator(const huge_page_allocator<U> &)
+			{
+			/* Nothing */
+			}
+
+		T *allocate(size_t count)
+			{
+			if (count > std::numeric_limits<size_t>::max() / sizeof(T))
+				throw std::bad_alloc();
+			void *memory = huge_pages::allocate(count * sizeof(T));
+			if (memory == nullptr)
+				throw std::bad_alloc();
+			return static_cast<T *>(memory);
+			}
+
+		void deallocate(T *memory, size_t)
+			{
+			huge_pages::release(memory);
+			}
+
+		template <typename U>
+		bool operator==(const huge_page_allocator<U> &) const
+			{
+			return true;
+			}
+
+		template <typename U>
+		bool operator!=(const huge_page_allocator<U> &) const
+			{
+			return false;
+			}
+	};
+
+/*
+	A std::vector on huge pages
+*/
+template <typename T>
+using huge_page_vector = std::vector<T, huge_page_allocator<T>>;
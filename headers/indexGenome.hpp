@@ -12,11 +12,15 @@
 #include <sys/stat.h>
 
 #include <map>
+#include <string>
 #include <vector>
 
+#include "hash.hpp"
+#include "hugePages.hpp"
 #include "protected_vector.hpp"
+#include "blockedBloomFilter.hpp"
 
 char *read_entire_file(const char *filename, uint64_t& fileSize);
 char *load_genome_file(const std::string &fastaFile, std::map<uint32_t, std::string> &referenceIDMap, uint64_t &genomeSize);
-void index_kmers(char *genome, uint64_t genomeSize, std::vector<protected_vector<uint32_t>> &kmersMap, uint32_t MASK);
+uint64_t index_kmers(char *genome, uint64_t genomeSize, huge_page_vector<protected_vector<uint32_t>> &kmersMap, uint32_t MASK, uint64_t from = 0, blocked_bloom_filter *prefilter = nullptr, hash_function hash = MURMUR_HASH, const std::map<uint32_t, std::string> *referenceIDMap = nullptr);
 
@@ -0,0 +1,72 @@
+/*
+	INDEXMETADATA.HPP
+	-----------------
+	indexReference
+
+	How an index was built (the format of its genome, which bucket hash and bucket layout, the size of its prefilter and which
+	buckets went to its repeat table), so that whatever reads the index finds buckets the same way.
+*/
+#pragma once
+
+#include <string>
+
+#include "hash.hpp"
+#include "bucketLayout.hpp"
+
+/*
+	GENOME_FORMAT
+	-------------
+	The format of _genome.idx, which changes whenever packGenome() changes what it keeps (and so where each base is):
+		1: only A, C, G and T (and any stray \r) were kept
+		2: everything but ID lines and white space is kept, so N and the other ambiguity codes are where they are in the FASTA
+*/
+static const uint32_t GENOME_FORMAT = 2;
+
+/*
+	CLASS INDEX_METADATA
+	--------------------
+*/
+/*!
+	@brief The settings an index was built with.  On disk this is one "<key> <value>" line per setting.  An index without
+	a metadata file predates it and so was built with the defaults, except that its genome format is not known.
+*/
+class index_metadata
+	{
+	public:
+		uint32_t genome_format;			// the GENOME_FORMAT of _genome.idx (0 if the index did not record it)
+		hash_function hash;				// bucket = hash(canonical) & MASK
+		bucket_layout layout;			// how the buckets are held in the Outer and Inner blobs
+		uint32_t prefilter_bits;		// bits per k-mer of the genome the prefilter was sized for (0 = no prefilter)
+		uint32_t repeat_threshold;		// buckets with more positions than this are in the repeat table (0 = no repeat table)
+		bool repeat_mask;					// if true the repeat table holds only the count of each of its buckets
+
+	public:
+		index_metadata() :
+			genome_format(GENOME_FORMAT),
+			hash(MURMUR_HASH),
+			layout(OFFSET_LAYOUT),
+			prefilter_bits(0),
+			repeat_threshold(0),
+			repeat_mask(false)
+			{
+			/* Nothing */
+			}
+
+		bool serialize(const std::string &filename) const;
+
+		/*!
+			@brief Read the metadata
+			@param filename [in] The file to read.
+			@returns false if the file exists but cannot be understood.  If it does not exist the defaults are kept and true returned.
+		*/
+		bool deserialize(const std::string &filename);
+
+		/*!
+			@brief Check that the genome is in the format this program reads and writes
+			@param baseName [in] The base name of the index (for the message).
+			@returns false (having said why) if the genome format is not GENOME_FORMAT (or is not recorded).
+		*/
+		bool genome_format_supported(const std::string &baseName) const;
+	};
+
+std::string indexMetadataFilename(const std::string &baseName);
@@ -0,0 +1,190 @@
+/*
+	INSTRUMENTATION.HPP
+	-------------------
+	indexReference
+
+	Low overhead instrumentation: per-thread progress counters sampled by a reporter thread, scoped phase timers with optional
+	hardware performance counters, and a JSON report of it all.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+/*
+	PROGRESS_INTERVAL
+	-----------------
+	Inner loops publish their progress every this many steps (a power of 2).
+*/
+static const uint64_t PROGRESS_INTERVAL = 4096;
+
+/*
+	CLASS PROGRESS_COUNTER
+	----------------------
+*/
+/*!
+	@brief How far one worker thread has got.  Padded to 128 bytes rather than aligned (a std::vector of them is only 16 byte
+	aligned), so however the counters fall across cache lines each thread's done is alone in its line and in the pair of
+	lines the adjacent line prefetcher fetches together.
+*/
+class progress_counter
+	{
+	public:
+		std::atomic<uint64_t> done;
+		uint64_t total;
+		char padding[128 - sizeof(std::atomic<uint64_t>) - sizeof(uint64_t)];
+
+	public:
+		progress_counter() :
+			done(0),
+			total(0)
+			{
+			/* Nothing */
+			}
+
+		/*
+			PROGRESS_COUNTER::SET()
+			-----------------------
+		*/
+		/*!
+			@brief Record progress.  A relaxed store to a line only this thread writes, but inner loops still call it only every
+			PROGRESS_INTERVAL steps.
+			@param so_far [in] The amount of work done.
+		*/
+		void set(uint64_t so_far)
+			{
+			done.store(so_far, std::memory_order_relaxed);
+			}
+	};
+
+/*
+	CLASS PROGRESS_REPORTER
+	-----------------------
+*/
+/*!
+	@brief A thread that samples a set of progress counters and prints the overall progress every update_interval percent.
+*/
+class progress_reporter
+	{
+	private:
+		std::vector<progress_counter> &counters;
+		uint64_t update_interval;
+		bool finished;
+		std::mutex lock;
+		std::condition_variable wake;
+		std::thread reporter;
+
+	private:
+		void report(void);
+
+	public:
+		progress_reporter(std::vector<progress_counter> &counters, uint64_t update_interval = 10);
+		~progress_reporter();
+	};
+
+/*
+	CLASS HARDWARE_COUNTERS
+	-----------------------
+*/
+/*!
+	@brief CPU cycles, last level cache misses, and branch misses (via perf_event_open) for this thread and any threads it
+	starts while counting.  If the counters are not available (not Linux, or not permitted) they all read as 0.
+*/
+class hardware_counters
+	{
+	public:
+		enum {CYCLES, LLC_MISSES, BRANCH_MISSES, COUNTERS};
+		static const char *name[COUNTERS];
+
+	private:
+		int fd[COUNTERS];
+
+	public:
+		hardware_counters();
+		~hardware_counters();
+
+		hardware_counters(const hardware_counters &) = delete;
+		hardware_counters &operator=(const hardware_counters &) = delete;
+
+		bool available(void) const;
+		void start(void);
+		void read(uint64_t *values);
+	};
+
+/*
+	CLASS PHASE_RECORD
+	------------------
+*/
+class phase_record
+	{
+	public:
+		std::string name;
+		double seconds;
+		bool counted;								// true if hardware counters were read
+		uint64_t counters[hardware_counters::COUNTERS];
+	};
+
+/*
+	CLASS STATS_REPORT
+	------------------
+*/
+/*!
+	@brief Everything measured during the run
+*/
+class stats_report
+	{
+	public:
+		bool use_hardware_counters;				// if true phase_timers also read the hardware counters
+		std::vector<phase_record> phases;
+		std::map<std::string, uint64_t> counters;
+
+	private:
+		std::mutex lock;
+
+	public:
+		stats_report() :
+			use_hardware_counters(false)
+			{
+			/* Nothing */
+			}
+
+		void add_phase(const phase_record &phase);
+		void add(const std::string &counter, uint64_t value);
+		bool write_json(const std::string &filename);
+	};
+
+extern stats_report run_statistics;
+
+/*
+	CLASS PHASE_TIMER
+	-----------------
+*/
+/*!
+	@brief Time a phase from construction to stop() (or destruction), print "<name> time: m min s sec" and add it to
+	run_statistics.
+*/
+class phase_timer
+	{
+	private:
+		std::string name;
+		std::chrono::steady_clock::time_point start;
+		hardware_counters *counters;
+		bool stopped;
+
+	public:
+		phase_timer(const std::string &name);
+		~phase_timer();
+
+		phase_timer(const phase_timer &) = delete;
+		phase_timer &operator=(const phase_timer &) = delete;
+
+		double stop(void);
+	};
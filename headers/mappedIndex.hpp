@@ -0,0 +1,180 @@
+/*
+	MAPPEDINDEX.HPP
+	---------------
+	indexReference
+
+	Open an index without reading it: the Outer and Inner blobs and the genome are memory mapped so that opening returns at
+	once and each page is read the first time a lookup touches it.  An index_warmer can then pull the whole index in from a
+	pool of threads in the background, so that a query process answers its first queries straight away and reaches full
+	speed soon after.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batchLookup.hpp"
+#include "indexMetadata.hpp"
+
+/*
+	CLASS MAPPED_FILE
+	-----------------
+*/
+/*!
+	@brief A whole file mapped read-only
+*/
+class mapped_file
+	{
+	private:
+		void *address;
+		uint64_t length;
+
+	public:
+		mapped_file() :
+			address(nullptr),
+			length(0)
+			{
+			/* Nothing */
+			}
+
+		mapped_file(const mapped_file &) = delete;
+		mapped_file &operator=(const mapped_file &) = delete;
+
+		~mapped_file()
+			{
+			close();
+			}
+
+		/*!
+			@brief Map the file (an empty file maps to nullptr and size 0)
+			@param filename [in] The file to map.
+			@returns false if it cannot be opened or mapped.
+		*/
+		bool open(const std::string &filename);
+		void close(void);
+
+		/*!
+			@brief Tell the kernel how the mapping will be read (MADV_RANDOM, as it is opened, or MADV_NORMAL, ...)
+		*/
+		void advise(int advice) const;
+
+		const char *data(void) const
+			{
+			return static_cast<const char *>(address);
+			}
+
+		uint64_t size(void) const
+			{
+			return length;
+			}
+	};
+
+/*
+	CLASS MAPPED_INDEX
+	------------------
+*/
+/*!
+	@brief An index (as written by indexReference, not sharded) opened by mapping its files
+*/
+class mapped_index
+	{
+	public:
+		mapped_file outer;				// _32_OuterBlob.idx
+		mapped_file inner;				// _32_InnerBlob.idx
+		mapped_file genome;				// _genome.idx
+		index_metadata metadata;
+		std::unique_ptr<blocked_bloom_filter> prefilter;		// _32_Prefilter.idx, if the index has one
+		std::unique_ptr<repeat_table> repeats;					// _32_Repeats.idx, if the index has one
+
+	public:
+		/*!
+			@brief Map the index of baseName.  Nothing is read but the metadata, the prefilter and the repeat table (if there
+			are, they are small), so this takes little longer than the system calls.
+			@param baseName [in] The base name of the index (as used by indexReference).
+			@returns false (having said why) if a file cannot be mapped, the metadata cannot be understood, the genome is not
+			in GENOME_FORMAT or the index is sharded.
+		*/
+		bool open(const std::string &baseName);
+
+		/*!
+			@brief A view of the mapped index for lookup_kmers() and lookup_kmers_interleaved()
+		*/
+		index_view view(void) const;
+
+		uint64_t size(void) const
+			{
+			return outer.size() + inner.size() + genome.size();
+			}
+	};
+
+/*
+	CLASS INDEX_WARMER
+	------------------
+*/
+/*!
+	@brief Fault a mapped index into memory in the background.  The mappings are cut into chunks (OuterBlob first as every
+	lookup reads it, then the InnerBlob, then the genome) and a pool of threads takes them in turn, asking the kernel to read
+	each ahead (MADV_WILLNEED) and then touching every page of it.  The mappings are returned to normal readahead while warming.
+*/
+class index_warmer
+	{
+	private:
+		class chunk
+			{
+			public:
+				const char *start;
+				uint64_t length;
+			};
+
+		std::vector<chunk> chunks;
+		std::vector<std::thread> threads;
+		std::atomic<size_t> next;				// the next chunk to warm
+		std::atomic<uint64_t> done;			// bytes warmed so far
+		uint64_t total;							// bytes to warm
+
+	private:
+		void warm(void);
+
+	public:
+		index_warmer() :
+			next(0),
+			done(0),
+			total(0)
+			{
+			/* Nothing */
+			}
+
+		~index_warmer()
+			{
+			wait();
+			}
+
+		/*!
+			@brief Start warming (returns at once)
+			@param index [in] The index to warm, which must stay open until wait() returns.
+			@param thread_count [in] The number of threads (0 = one per core).
+			@param chunk_size [in] Bytes each thread warms at a time.
+		*/
+		void start(const mapped_index &index, size_t thread_count = 0, uint64_t chunk_size = 16 * 1024 * 1024);
+
+		/*!
+			@brief Wait for warming to finish
+			@param report [in] If true, print the progress (every 10%) while waiting.
+		*/
+		void wait(bool report = false);
+
+		uint64_t warmed(void) const
+			{
+			return done;
+			}
+
+		uint64_t size(void) const
+			{
+			return total;
+			}
+	};
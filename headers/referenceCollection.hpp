@@ -0,0 +1,36 @@
+/*
+	REFERENCECOLLECTION.HPP
+	-----------------------
+	indexReference
+
+	Load a reference collection of many FASTA files (given as a list, a directory, or a manifest) into one packed genome blob.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/*!
+	@brief Add the FASTA files named by path to files.
+	@param path [in] A FASTA file, a directory (searched recursively for .fa, .fas, .fasta, .fna, .ffn and .frn files, in name
+	order), or @ followed by the name of a manifest listing one file or directory per line (relative to the manifest's directory,
+	blank lines and lines starting with # are skipped).
+	@param files [in/out] The files are appended to this.
+	@returns false if path (or something it lists) cannot be read.
+*/
+bool list_reference_files(const std::string &path, std::vector<std::string> &files);
+
+/*!
+	@brief Load and pack the files, in parallel, into one genome blob laid out in the order given.
+	@param files [in] The FASTA files.
+	@param referenceIDMap [out] The offset and ID line of each record.  A file that does not start with an ID line gets one
+	made from its filename.
+	@param fileIDMap [out] The offset and filename of each (non-empty) file, in the same format as referenceIDMap.
+	@param genomeSize [out] The number of bases in the blob.
+	@param readers [in] The number of reader threads (0 for one per core).
+	@returns The blob (free with huge_pages::release()).  Exits if a file cannot be read.
+*/
+char *load_genome_files(const std::vector<std::string> &files, std::map<uint32_t, std::string> &referenceIDMap, std::map<uint32_t, std::string> &fileIDMap, uint64_t &genomeSize, size_t readers = 0);
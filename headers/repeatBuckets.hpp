@@ -0,0 +1,202 @@
+/*
+	REPEATBUCKETS.HPP
+	-----------------
+	indexReference
+
+	Bucket size statistics, and a side table for the high-frequency (repeat) buckets that are taken out of the index.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "hugePages.hpp"
+#include "protected_vector.hpp"
+
+/*
+	CLASS BUCKET_STATISTICS
+	-----------------------
+*/
+/*!
+	@brief The distribution of posting list lengths over the buckets of an index
+*/
+class bucket_statistics
+	{
+	public:
+		uint64_t buckets;						// number of buckets
+		uint64_t occupied;					// number of non-empty buckets
+		uint64_t postings;					// total number of positions
+		uint64_t largest;						// longest posting list
+		std::map<uint64_t, uint64_t> histogram;	// posting list length -> number of (non-empty) buckets of that length
+
+	public:
+		bucket_statistics() :
+			buckets(0),
+			occupied(0),
+			postings(0),
+			largest(0)
+			{
+			/* Nothing */
+			}
+
+		/*
+			BUCKET_STATISTICS::COMPUTE()
+			----------------------------
+		*/
+		/*!
+			@brief Gather the statistics
+			@param bucket_count [in] The number of buckets.
+			@param size_of [in] A function returning the posting list length of a given bucket.
+		*/
+		template <typename SIZE_OF>
+		void compute(uint64_t bucket_count, SIZE_OF size_of)
+			{
+			buckets = bucket_count;
+			occupied = postings = largest = 0;
+			histogram.clear();
+
+			for (uint64_t bucket = 0; bucket < bucket_count; bucket++)
+				{
+				uint64_t length = size_of(bucket);
+				if (length != 0)
+					{
+					occupied++;
+					postings += length;
+					largest = length > largest ? length : largest;
+					histogram[length]++;
+					}
+				}
+			}
+
+		uint64_t percentile(double percent) const;
+		uint64_t buckets_over(uint64_t threshold, uint64_t *positions = nullptr) const;
+		void report(std::ostream &out, uint64_t threshold = 0) const;
+	};
+
+/*
+	CLASS REPEAT_BUCKET
+	-------------------
+*/
+/*!
+	@brief One entry in the repeat table
+*/
+class repeat_bucket
+	{
+	public:
+		uint32_t bucket;		// the bucket (kmerHash & MASK)
+		uint32_t count;		// the number of positions in the bucket
+		uint32_t offset;		// where the stored positions start in the table's positions
+		uint32_t stored;		// the number of positions stored (0 if the bucket was masked)
+	};
+
+/*
+	CLASS REPEAT_TABLE
+	------------------
+*/
+/*!
+	@brief The buckets moved out of the index because they are too long.  On disk this is the number of entries, the entries
+	(sorted by bucket), then the stored positions.  A bucket in the table is empty in the index, so a lookup that finds an
+	empty bucket must look here too.
+*/
+class repeat_table
+	{
+	public:
+		std::vector<repeat_bucket> entries;
+		std::vector<uint32_t> positions;
+
+	public:
+		bool serialize(const std::string &filename) const;
+		bool deserialize(const std::string &filename);
+
+		/*!
+			@brief Find a bucket in the table
+			@param bucket [in] The bucket to look for.
+			@returns The entry, or nullptr if the bucket is not a repeat bucket (and so is in the index as normal).
+		*/
+		const repeat_bucket *find(uint32_t bucket) const;
+
+		/*!
+			@brief Move the buckets longer than threshold out of kmersMap and into the table
+			@param kmersMap [in/out] The index, the moved buckets are left empty.
+			@param threshold [in] Buckets with more than this many positions are moved.
+			@param keepPositions [in] If true the (sorted) positions are kept in the table, otherwise only the count is kept.
+		*/
+		void extract(huge_page_vector<protected_vector<uint32_t>> &kmersMap, uint32_t threshold, bool keepPositions);
+
+		/*!
+			@brief Move any new positions in the table's buckets out of kmersMap (used when appending to an index)
+			@param kmersMap [in/out] The newly indexed positions.
+		*/
+		void absorb(huge_page_vector<protected_vector<uint32_t>> &kmersMap);
+
+		/*
+			REPEAT_TABLE::EXTRACT_GROWN()
+			-----------------------------
+		*/
+		/*!
+			@brief After absorb(), move the buckets that an append has taken over threshold into the table (their existing
+			positions must then be left out of the index, as appendToSerializedMap() does for the buckets in the table)
+			@param kmersMap [in/out] The newly indexed positions, the moved buckets are left empty.
+			@param threshold [in] Buckets with more than this many positions (existing and new) are moved.
+			@param keepPositions [in] If true the (sorted) positions are kept in the table, otherwise only the count is kept.
+			@param existing [in] A function returning the number of positions a bucket has in the existing index, as
+			bucket_positions() does: size_t existing(uint64_t bucket, const uint32_t *&positions, uint32_t scratch[2]).
+		*/
+		template <typename EXISTING>
+		void extract_grown(huge_page_vector<protected_vector<uint32_t>> &kmersMap, uint32_t threshold, bool keepPositions, EXISTING existing)
+			{
+			size_t previous = entries.size();
+
+			for (size_t bucket = 0; bucket < kmersMap.size(); bucket++)
+				{
+				auto &innerVector = kmersMap[bucket];
+				if (innerVector.empty())
+					continue;			// not grown (or already in the table, as absorb() empties those)
+
+				const uint32_t *positionsBefore;
+				uint32_t scratch[2];
+				size_t sizeBefore = existing(bucket, positionsBefore, scratch);
+				if (sizeBefore + innerVector.size() <= threshold)
+					continue;
+
+				repeat_bucket entry;
+				entry.bucket = static_cast<uint32_t>(bucket);
+				entry.count = static_cast<uint32_t>(sizeBefore + innerVector.size());
+				entry.offset = static_cast<uint32_t>(positions.size());
+				entry.stored = 0;
+				if (keepPositions)
+					{
+					std::sort(innerVector.begin(), innerVector.end());
+					positions.insert(positions.end(), positionsBefore, positionsBefore + sizeBefore);
+					positions.insert(positions.end(), innerVector.begin(), innerVector.end());
+					entry.stored = entry.count;
+					}
+				entries.push_back(entry);
+
+				std::vector<uint32_t>().swap(innerVector);
+				}
+
+			/*
+				Put the new entries in bucket order, and their positions in the same order (as extract() leaves them)
+			*/
+			if (entries.size() != previous)
+				{
+				std::sort(entries.begin(), entries.end(), [](const repeat_bucket &first, const repeat_bucket &second) { return first.bucket < second.bucket; });
+				std::vector<uint32_t> ordered;
+				ordered.reserve(positions.size());
+				for (auto &entry : entries)
+					{
+					ordered.insert(ordered.end(), positions.begin() + entry.offset, positions.begin() + entry.offset + entry.stored);
+					entry.offset = static_cast<uint32_t>(ordered.size() - entry.stored);
+					}
+				positions.swap(ordered);
+				}
+			}
+	};
+
+std::string repeatTableFilename(const std::string &baseName);
@@ -0,0 +1,115 @@
+/*
+	SEEDEXTENSION.HPP
+	-----------------
+	indexReference
+
+	Verify that a seed (a 32-mer of a query that hit a bucket) really occurs at a genome position, on either strand, and
+	extend it to the longest exact match.  There are two kernels: one over the one-byte-per-base genome (16 bases per
+	compare with SSE2) and one over a genome packed 2 bits per base (32 bases per XOR, the first difference found with a
+	count of trailing or leading zeros).  Both give the same answer.  A base other than A, C, G or T (such as N) never matches.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "hugePages.hpp"
+
+/*
+	CLASS SEED_QUERY
+	----------------
+*/
+/*!
+	@brief A query prepared for extension on both strands: its forward and reverse complement sequences, as lower case
+	acgt bytes (anything else '\0') and packed 2 bits per base with a mask of the bases that are not acgt.  Each is padded
+	either side so that the kernels can read whole blocks without checking the ends.
+*/
+class seed_query
+	{
+	public:
+		static const uint32_t PADDING = 32;				// bases of padding either side (never matches anything)
+
+	public:
+		uint32_t length;										// length of the query in bases
+		std::vector<char> ascii[2];						// [0] forward, [1] reverse complement
+		std::vector<uint64_t> bases[2];					// 2 bits per base, base i at bits 2 * (i % 32) of word i / 32
+		std::vector<uint64_t> ambiguous[2];				// 01 at each base that is not A, C, G or T
+
+	public:
+		seed_query() :
+			length(0)
+			{
+			/* Nothing */
+			}
+
+		seed_query(const char *sequence, uint32_t length)
+			{
+			assign(sequence, length);
+			}
+
+		/*!
+			@brief Prepare a query (the buffers are reused, so one seed_query can be used for each query in turn)
+			@param sequence [in] The query bases (either case).
+			@param length [in] The number of bases.
+		*/
+		void assign(const char *sequence, uint32_t length);
+	};
+
+/*
+	CLASS PACKED_GENOME
+	-------------------
+*/
+/*!
+	@brief The genome packed 2 bits per base (half the size of the byte per base genome, including the ambiguity mask),
+	in the same layout as seed_query::bases.
+*/
+class packed_genome
+	{
+	public:
+		uint64_t size;											// length of the genome in bases
+		huge_page_vector<uint64_t> bases;
+		huge_page_vector<uint64_t> ambiguous;
+
+	public:
+		packed_genome() :
+			size(0)
+			{
+			/* Nothing */
+			}
+
+		void assign(const char *genome, uint64_t size);
+	};
+
+/*
+	CLASS SEED_MATCH
+	----------------
+*/
+/*!
+	@brief The exact match found by extending a seed
+*/
+class seed_match
+	{
+	public:
+		uint32_t query_start;		// where the match starts in the query (counting along the forward strand of the query)
+		uint32_t position;			// where the match starts in the genome
+		uint32_t length;				// bases matched, 0 if the seed is not at the position on either strand
+		bool reverse;					// true if the genome holds the reverse complement of the query
+	};
+
+/*!
+	@brief Verify and extend a seed against the one byte per base genome
+	@param genome [in] The genome (as written to _genome.idx, either case).
+	@param first [in] The match is kept within [first, last), normally the record holding position.
+	@param last [in] See first.
+	@param query [in] The query.
+	@param seed [in] Where the seed starts in the (forward) query.
+	@param position [in] Where in the genome the seed is said to be (a position from its bucket).
+	@returns The match.  If the seed is there on both strands (a palindrome) the forward strand is taken.
+*/
+seed_match extend_seed(const char *genome, uint64_t first, uint64_t last, const seed_query &query, uint32_t seed, uint32_t position);
+
+/*!
+	@brief Verify and extend a seed against the 2-bit packed genome, the parameters are as for the byte per base version.
+*/
+seed_match extend_seed(const packed_genome &genome, uint64_t first, uint64_t last, const seed_query &query, uint32_t seed, uint32_t position);
@@ -12,10 +12,15 @@
 
 #include <vector>
 
+#include "hugePages.hpp"
+#include "bucketLayout.hpp"
+#include "repeatBuckets.hpp"
 #include "protected_vector.hpp"
 
-void serializeMap(std::vector<protected_vector<uint32_t>>& kmersMap, const std::string& innerMapFilename, const std::string& outerMapFilename);
-void deserializeMap(const std::string& innerMapFilename, const std::string& outerMapFilename, std::vector<uint32_t>& innerMapBlob, std::vector<uint32_t>& outerMapBlob);
-std::vector<uint32_t> getInnerVector(const std::vector<uint32_t>& innerMapBlob, const std::vector<uint32_t>& outerMapBlob, size_t index);
+void serializeMap(huge_page_vector<protected_vector<uint32_t>>& kmersMap, const std::string& innerMapFilename, const std::string& outerMapFilename, bucket_layout layout = OFFSET_LAYOUT);
+void serializeMapRange(huge_page_vector<protected_vector<uint32_t>>& kmersMap, size_t first, size_t last, const std::string& innerMapFilename, const std::string& outerMapFilename, bucket_layout layout = OFFSET_LAYOUT);
+void appendToSerializedMap(const huge_page_vector<uint32_t>& innerMapBlob, const huge_page_vector<uint32_t>& outerMapBlob, huge_page_vector<protected_vector<uint32_t>>& kmersMap, const std::string& innerMapFilename, const std::string& outerMapFilename, bucket_layout layout = OFFSET_LAYOUT, const repeat_table *repeats = nullptr);
+bool deserializeMap(const std::string& innerMapFilename, const std::string& outerMapFilename, huge_page_vector<uint32_t>& innerMapBlob, huge_page_vector<uint32_t>& outerMapBlob, bucket_layout layout = OFFSET_LAYOUT);
+std::vector<uint32_t> getInnerVector(const huge_page_vector<uint32_t>& innerMapBlob, const huge_page_vector<uint32_t>& outerMapBlob, size_t index, bucket_layout layout = OFFSET_LAYOUT);
 bool writeTextBlobToFile(const char* text, std::size_t length, const std::string& filename);
 std::pair<char*, std::size_t> readTextBlobFromFile(const std::string& filename);
\ No newline at end of file
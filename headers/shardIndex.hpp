@@ -0,0 +1,165 @@
+/*
+	SHARDINDEX.HPP
+	--------------
+	indexReference
+
+	Split the index into shards, each covering a contiguous range of the kmerHash space, and route queries to them.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hash.hpp"
+#include "hugePages.hpp"
+#include "bucketLayout.hpp"
+#include "repeatBuckets.hpp"
+#include "protected_vector.hpp"
+
+/*
+	CLASS SHARD_RANGE
+	-----------------
+*/
+/*!
+	@brief The buckets [first, last) of the kmerHash space held by one shard
+*/
+class shard_range
+	{
+	public:
+		uint64_t first;
+		uint64_t last;
+	};
+
+std::string shardFilename(const std::string &baseName, size_t shard, const std::string &blob);
+std::string shardManifestFilename(const std::string &baseName);
+void serializeShards(huge_page_vector<protected_vector<uint32_t>> &kmersMap, const std::string &baseName, size_t shardCount, bucket_layout layout = OFFSET_LAYOUT);
+bool readShardManifest(const std::string &baseName, uint64_t &bucketCount, std::vector<shard_range> &ranges);
+void removeShards(const std::string &baseName);
+
+/*
+	CLASS SHARD_BACKEND
+	-------------------
+*/
+/*!
+	@brief Something that can answer bucket lookups for one shard
+*/
+class shard_backend
+	{
+	public:
+		virtual ~shard_backend()
+			{
+			/* Nothing */
+			}
+
+		/*!
+			@brief Look up a batch of buckets (global bucket numbers, all within this shard)
+			@param buckets [in] The buckets to look up.
+			@param postings [out] The positions in each bucket (without the sentinal), one vector per bucket.
+			@returns false if the shard could not answer (postings is then incomplete and must not be used).
+		*/
+		virtual bool lookup(const std::vector<uint32_t> &buckets, std::vector<std::vector<uint32_t>> &postings) = 0;
+	};
+
+/*
+	CLASS LOCAL_SHARD
+	-----------------
+*/
+/*!
+	@brief A shard loaded into this process
+*/
+class local_shard : public shard_backend
+	{
+	private:
+		shard_range range;
+		bucket_layout layout;
+		huge_page_vector<uint32_t> innerMapBlob;
+		huge_page_vector<uint32_t> outerMapBlob;
+
+	public:
+		local_shard(const shard_range &range, bucket_layout layout = OFFSET_LAYOUT) :
+			range(range),
+			layout(layout)
+			{
+			/* Nothing */
+			}
+
+		/*!
+			@brief Load the shard's blobs
+			@param baseName [in] The base name of the index (as used by indexReference).
+			@param shard [in] Which shard this is.
+			@returns false (having said why) if the blobs cannot be read.
+		*/
+		bool open(const std::string &baseName, size_t shard);
+
+		virtual bool lookup(const std::vector<uint32_t> &buckets, std::vector<std::vector<uint32_t>> &postings);
+	};
+
+/*
+	CLASS PROCESS_SHARD
+	-------------------
+*/
+/*!
+	@brief A shard served by a child process, talked to over a pair of pipes.  Once a request or reply fails (the child
+	died, or a pipe came up short) the shard is marked failed and answers no more lookups.
+*/
+class process_shard : public shard_backend
+	{
+	private:
+		pid_t child;
+		int request_fd;
+		int reply_fd;
+		bool failed;
+
+	public:
+		process_shard(const std::string &baseName, size_t shard, const shard_range &range, bucket_layout layout = OFFSET_LAYOUT);
+		virtual ~process_shard();
+		virtual bool lookup(const std::vector<uint32_t> &buckets, std::vector<std::vector<uint32_t>> &postings);
+	};
+
+/*
+	CLASS SHARD_ROUTER
+	------------------
+*/
+/*!
+	@brief Scatter a batch of k-mers to the shards that hold them and gather the posting lists back in query order.  If a
+	shard process fails it is replaced by the shard loaded in this process.  The buckets moved to the repeat table are
+	answered from the table, which the router holds.
+*/
+class shard_router
+	{
+	private:
+		std::string baseName;
+		uint32_t MASK;
+		hash_function hash;
+		bucket_layout layout;
+		std::vector<shard_range> ranges;
+		std::vector<std::unique_ptr<shard_backend>> backends;
+		repeat_table repeats;
+
+	public:
+		/*!
+			@brief Open the shards of the index of baseName
+			@param baseName [in] The base name of the index (as used by indexReference).
+			@param separateProcesses [in] If true each shard is served by its own child process, otherwise in-process.
+		*/
+		shard_router(const std::string &baseName, bool separateProcesses = false);
+
+		size_t shard_count(void) const
+			{
+			return ranges.size();
+			}
+
+		size_t shard_of(uint32_t bucket) const;
+
+		/*!
+			@brief Look up a batch of k-mers
+			@param canonicalKmers [in] The canonical k-mers.
+			@param postings [out] The positions in each k-mer's bucket (not verified against the genome), in query order.
+			@param masked [out] If not nullptr, for each k-mer 0 or, if its bucket is a repeat bucket kept only as a count, that count.
+		*/
+		void lookup(const std::vector<uint64_t> &canonicalKmers, std::vector<std::vector<uint32_t>> &postings, std::vector<uint32_t> *masked = nullptr);
+	};
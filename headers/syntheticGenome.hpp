@@ -0,0 +1,52 @@
+/*
+	SYNTHETICGENOME.HPP
+	-------------------
+	indexReference
+
+	Generate reproducible synthetic reference collections (as FASTA) for benchmarking.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+
+/*
+	CLASS SYNTHETIC_GENOME_PARAMETERS
+	---------------------------------
+*/
+/*!
+	@brief What to generate.  The same parameters (including the seed) always give the same FASTA.
+*/
+class synthetic_genome_parameters
+	{
+	public:
+		uint64_t seed;					// random number seed
+		uint64_t bases;					// number of bases (including N runs) over all records
+		uint32_t records;					// number of FASTA records to split the bases over
+		double repeat_fraction;			// proportion of the bases that are copies of a repeat element
+		uint32_t repeat_length;			// length of each repeat element
+		uint32_t repeat_families;		// number of distinct repeat elements
+		double repeat_divergence;		// per-base substitution rate applied to each repeat copy
+		uint32_t n_runs;					// number of runs of N
+		uint32_t n_run_length;			// length of each run of N
+		uint32_t line_length;			// FASTA line length
+
+	public:
+		synthetic_genome_parameters() :
+			seed(1),
+			bases(10000000),
+			records(1),
+			repeat_fraction(0.1),
+			repeat_length(5000),
+			repeat_families(8),
+			repeat_divergence(0.01),
+			n_runs(10),
+			n_run_length(100),
+			line_length(80)
+			{
+			/* Nothing */
+			}
+	};
+
+std::string generate_synthetic_genome(const synthetic_genome_parameters &parameters);
@@ -0,0 +1,225 @@
+/*
+	HUGEPAGES.CPP
+	-------------
+	indexReference
+
+	Allocate the large, randomly accessed structures on huge pages.
+*/
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "hugePages.hpp"
+
+#ifndef MAP_HUGE_SHIFT
+	#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+	#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+	#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+bool huge_pages::enabled = true;
+
+/*
+	CLASS REGION
+	------------
+	A live allocation: the mapping (which might be larger than asked for, for alignment) and how it is backed.
+*/
+class region
+	{
+	public:
+		void *mapping;
+		size_t mapping_bytes;
+		size_t bytes;
+		huge_pages::backing backing;
+	};
+
+static std::mutex regions_lock;
+static std::map<char *, region> regions;
+
+/*
+	MAP_HUGETLB_PAGES()
+	-------------------
+*/
+static void *map_hugetlb_pages(size_t bytes, size_t page_size, int flags)
+	{
+#ifdef MAP_HUGETLB
+	size_t rounded = (bytes + page_size - 1) / page_size * page_size;
+	void *memory = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | flags, -1, 0);
+	return memory == MAP_FAILED ? nullptr : memory;
+#else
+	return nullptr;
+#endif
+	}
+
+/*
+	HUGE_PAGES::ALLOCATE()
+	----------------------
+*/
+void *huge_pages::allocate(size_t bytes)
+	{
+	if (bytes < HUGE_PAGE_SIZE)
+		return malloc(bytes == 0 ? 1 : bytes);
+
+	region allocation = {nullptr, 0, bytes, NONE};
+	char *memory = nullptr;
+
+	if (enabled)
+		{
+		/*
+			hugetlbfs pages (only available if the administrator has reserved some)
+		*/
+		const size_t GIGABYTE = 1024 * 1024 * 1024;
+		if (bytes >= GIGABYTE && (memory = static_cast<char *>(map_hugetlb_pages(bytes, GIGABYTE, MAP_HUGE_1GB))) != nullptr)
+			allocation = {memory, (bytes + GIGABYTE - 1) / GIGABYTE * GIGABYTE, bytes, HUGETLB_1GB};
+		else if ((memory = static_cast<char *>(map_hugetlb_pages(bytes, HUGE_PAGE_SIZE, MAP_HUGE_2MB))) != nullptr)
+			allocation = {memory, (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE, bytes, HUGETLB_2MB};
+		}
+
+	if (memory == nullptr)
+		{
+		/*
+			Ordinary pages, 2MB aligned so that the kernel can back them with transparent huge pages
+		*/
+		size_t mapping_bytes = bytes + HUGE_PAGE_SIZE;
+		void *mapping = mmap(nullptr, mapping_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapping == MAP_FAILED)
+			return nullptr;
+
+		memory = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(mapping) + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+		allocation = {mapping, mapping_bytes, bytes, NONE};
+
+#ifdef MADV_HUGEPAGE
+		/*
+			Advise whole huge pages, but no further than the end of the mapping (which is short of the last one unless the
+			mapping happened to be 2MB aligned already)
+		*/
+		size_t advise_bytes = std::min<size_t>((bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1), static_cast<char *>(mapping) + mapping_bytes - memory);
+		if (enabled && madvise(memory, advise_bytes, MADV_HUGEPAGE) == 0)
+			allocation.backing = TRANSPARENT;
+#endif
+#ifdef MADV_NOHUGEPAGE
+		if (!enabled)
+			madvise(mapping, mapping_bytes, MADV_NOHUGEPAGE);
+#endif
+		}
+
+	std::lock_guard<std::mutex> guard(regions_lock);
+	regions[memory] = allocation;
+
+	return memory;
+	}
+
+/*
+	HUGE_PAGES::RELEASE()
+	---------------------
+*/
+void huge_pages::release(void *memory)
+	{
+	if (memory == nullptr)
+		return;
+
+	std::unique_lock<std::mutex> guard(regions_lock);
+	auto found = regions.find(static_cast<char *>(memory));
+	if (found != regions.end())
+		{
+		munmap(found->second.mapping, found->second.mapping_bytes);
+		regions.erase(found);
+		return;
+		}
+	guard.unlock();
+
+	free(memory);
+	}
+
+/*
+	HUGE_BYTES()
+	------------
+	How much of [start, start + bytes) is on transparent huge pages, according to /proc/self/smaps.  A mapping partly inside
+	the range is counted in proportion.
+*/
+static uint64_t huge_bytes(const char *start, size_t bytes)
+	{
+	std::ifstream smaps("/proc/self/smaps");
+	std::string line;
+	uintptr_t from = reinterpret_cast<uintptr_t>(start);
+	uintptr_t to = from + bytes;
+	uintptr_t mapping_from = 0;
+	uintptr_t mapping_to = 0;
+	uint64_t total = 0;
+
+	while (std::getline(smaps, line))
+		{
+		uintptr_t low;
+		uintptr_t high;
+		char dash;
+		std::istringstream fields(line);
+
+		if (line.compare(0, 14, "AnonHugePages:") == 0)
+			{
+			std::string name;
+			uint64_t kilobytes;
+			fields >> name >> kilobytes;
+			uintptr_t overlap_from = std::max(from, mapping_from);
+			uintptr_t overlap_to = std::min(to, mapping_to);
+			if (overlap_to > overlap_from && mapping_to > mapping_from)
+				total += kilobytes * 1024 * (overlap_to - overlap_from) / (mapping_to - mapping_from);
+			}
+		else if ((fields >> std::hex >> low >> dash >> high) && dash == '-')
+			{
+			mapping_from = low;
+			mapping_to = high;
+			}
+		}
+
+	return total;
+	}
+
+/*
+	HUGE_PAGES::COVERAGE()
+	----------------------
+*/
+void huge_pages::coverage(uint64_t &allocated, uint64_t &huge)
+	{
+	std::lock_guard<std::mutex> guard(regions_lock);
+
+	allocated = huge = 0;
+	for (const auto &allocation : regions)
+		{
+		allocated += allocation.second.bytes;
+		if (allocation.second.backing == HUGETLB_1GB || allocation.second.backing == HUGETLB_2MB)
+			huge += allocation.second.bytes;
+		else if (allocation.second.backing == TRANSPARENT)
+			huge += std::min<uint64_t>(allocation.second.bytes, huge_bytes(allocation.first, allocation.second.bytes));
+		}
+	}
+
+/*
+	HUGE_PAGES::REPORT()
+	--------------------
+*/
+void huge_pages::report(std::ostream &out)
+	{
+	static const char *backing_name[] = {"4KB pages", "transparent huge pages", "2MB hugetlbfs pages", "1GB hugetlbfs pages"};
+	std::lock_guard<std::mutex> guard(regions_lock);
+
+	for (const auto &allocation : regions)
+		{
+		uint64_t huge = allocation.second.bytes;
+		if (allocation.second.backing == TRANSPARENT)
+			huge = std::min<uint64_t>(allocation.second.bytes, huge_bytes(allocation.first, allocation.second.bytes));
+		else if (allocation.second.backing == NONE)
+			huge = 0;
+
+		out << "  " << allocation.second.bytes / (1024 * 1024) << " MB using " << backing_name[allocation.second.backing] << ", " << huge * 100.0 / allocation.second.bytes << "% on huge pages" << std::endl;
+		}
+	}
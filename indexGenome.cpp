@@ -10,38 +10,18 @@
 #include <thread>
 #include <iomanip>
 #include <iostream>
+#include <algorithm>
 
 #include "hash.hpp"
 #include "indexGenome.hpp"
 #include "packGenomeBlob.hpp"
 #include "encode_kmer_2bit.h"
-
-/*
-	DISPLAYPROGRESS()
-	-----------------
-	// example of use:
-	int totalIterations = 1000;
-	int percentUpdateInterval = 10; // Update progress every 10%
-
-	for (int i = 0; i < totalIterations; ++i)
-		{
-		displayProgress(i + 1, totalIterations, percentUpdateInterval);
-		}
-*/
-void displayProgress(std::chrono::time_point<std::chrono::steady_clock> &start, uint64_t &lastDisplayedPercent, uint64_t current, uint64_t total, int desiredUpdateInterval)
-	{
-	uint64_t percent = (current * 100) / total;
-	if (percent - lastDisplayedPercent >= desiredUpdateInterval)
-		{
-		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
-		std::cout << "progress:" << percent << " (" << duration << " miliseconds)\n";
-		lastDisplayedPercent = percent;
-		}
-	}
+#include "instrumentation.hpp"
 
 /*
     READ_ENTIRE_FILE()
     ------------------
+	The contents are allocated with huge_pages::allocate() so free them with huge_pages::release().
 */
 char *read_entire_file(const char *filename, uint64_t &fileSize)
 	{
@@ -55,10 +35,10 @@ char *read_entire_file(const char *filename, uint64_t &fileSize)
 			{
 			if (details.st_size != 0 || details.st_size > UINT32_MAX)
 				{
-				contents = (char *)malloc(details.st_size + 1);
-				if (fread(contents, details.st_size, 1, fp) != 1)
+				contents = (char *)huge_pages::allocate(details.st_size + 1);
+				if (contents == NULL || fread(contents, details.st_size, 1, fp) != 1)
 					{
-					free(contents);
+					huge_pages::release(contents);
 					contents = NULL;
 					}
 				else
@@ -93,7 +73,7 @@ char *load_genome_file(const std::string &fastaFile, std::map<uint32_t, std::str
 	std::cout << "Reference file size on disk " << fileSize << std::endl;
 
 	/*
-		Remove all non-base data from the file.
+		Remove the ID lines and line breaks from the file.
 	*/
 	genomeSize = packGenome(genome, fileSize, referenceIDMap);
 	std::cout << "        Reference blob size " << genomeSize << std::endl;
@@ -104,14 +84,35 @@ char *load_genome_file(const std::string &fastaFile, std::map<uint32_t, std::str
 /*
 	INDEX_KMERS_THREAD()
 	--------------------
+	Templated on the hash policy so that the hash is inlined into the loop.  recordStarts is sorted, *skipped is set to the
+	number of windows not indexed because they span a record start or include a base that is not A, C, G or T.
 */
-void index_kmers_thread(char *genome, uint64_t offset, uint64_t genomeSize, std::vector<protected_vector<uint32_t>> &kmersMap, uint32_t MASK)
+template <typename HASH>
+void index_kmers_thread(char *genome, uint64_t offset, uint64_t genomeSize, huge_page_vector<protected_vector<uint32_t>> &kmersMap, uint32_t MASK, blocked_bloom_filter *prefilter, const std::vector<uint32_t> &recordStarts, progress_counter *progress, uint64_t *skipped)
 	{
 //printf("%llu bytes from %p\n", genomeSize, genome);
 
+	/*
+		valid is the number of bases (A, C, G or T, all in the same record) ending at the last base added, so the window is
+		a real k-mer when it reaches 32.  It is kept without branching: a record start multiplies it by 0 before adding the
+		base, an ambiguous base multiplies the result by 0.
+	*/
+	const char *sequence = genome;
+	uint64_t valid = 0;
+	uint64_t not_indexed = 0;
+	auto boundary = std::lower_bound(recordStarts.begin(), recordStarts.end(), offset);
+	uint64_t next_start = boundary == recordStarts.end() ? UINT64_MAX : *boundary;
+	auto add_base = [&](uint64_t at)
+		{
+		uint64_t record_start = at == next_start;
+		valid = (valid * (1 - record_start) + 1) * encode_kmer_2bit::is_base(sequence[at]);
+		if (record_start)
+			next_start = ++boundary == recordStarts.end() ? UINT64_MAX : *boundary;
+		};
+	for (uint64_t at = offset; at < offset + 31; at++)
+		add_base(at);
+
 	genome += offset;
-    auto start = std::chrono::steady_clock::now();
-	uint64_t lastDisplayedPercent = -10; // Initialize to a value that will trigger the first update
 	/*
 		Index by sliding a windows over the genome.  As the reverse complement is also needed, its done by
 		keeping two "running windows" and shifting them then adding to the end.  That is, (pkmer << 2 | new_base)
@@ -125,31 +126,63 @@ void index_kmers_thread(char *genome, uint64_t offset, uint64_t genomeSize, std:
 	for (uint32_t pos = 0; pos < genomeSize; pos++)
 		{
 //std::cout << "encoding the genome\n"; 
+		add_base(offset + pos + 31);
 		uint64_t new_base = encode_kmer_2bit::pack_1mer(*encode_pos++);
 		pkmer = (pkmer << 2) | new_base;
 		remkp = (remkp >> 2) | (~new_base << 62);
-		uint64_t cononical = pkmer ^ remkp;
-		uint32_t kmerHash = murmurHash3(cononical) & MASK;
-		kmersMap[kmerHash].push_back(pos + offset);
-		displayProgress(start, lastDisplayedPercent, pos, genomeSize, 10);
+		uint64_t indexable = valid >= 32;
+		not_indexed += 1 - indexable;
+		if (indexable)
+			{
+			uint64_t cononical = pkmer ^ remkp;
+			if (!kmersMap.empty())
+				kmersMap[HASH::hash(cononical) & MASK].push_back(pos + offset);
+			if (prefilter != nullptr)
+				prefilter->insert(cononical);
+			}
+		if ((pos & (PROGRESS_INTERVAL - 1)) == 0)
+			progress->set(pos);
 		}
+	progress->set(genomeSize);
+	*skipped = not_indexed;
 	}
 
 /*
 	INDEX_KMERS()
 	-------------
+	Index the k-mers starting at positions [from, genomeSize - 32).  A full build uses from = 0, an incremental
+	append passes the first position that was not in the existing index.  If prefilter is not nullptr then each
+	canonical k-mer is also added to it, and if kmersMap is empty only the prefilter is filled.  The bucket of each k-mer
+	is hash(canonical) & MASK.  Windows that span the start of a record in referenceIDMap (if given), or that include
+	anything other than A, C, G or T, are not indexed and their number is returned.
 */
-void index_kmers(char *genome, uint64_t genomeSize, std::vector<protected_vector<uint32_t>> &kmersMap, uint32_t MASK)
+uint64_t index_kmers(char *genome, uint64_t genomeSize, huge_page_vector<protected_vector<uint32_t>> &kmersMap, uint32_t MASK, uint64_t from, blocked_bloom_filter *prefilter, hash_function hash, const std::map<uint32_t, std::string> *referenceIDMap)
 	{
+	auto worker = HASH_DISPATCH(hash, index_kmers_thread);
+
+	if (genomeSize < from + 32)
+		return 0;
+
+	std::vector<uint32_t> recordStarts;
+	if (referenceIDMap != nullptr)
+		for (const auto &record : *referenceIDMap)
+			recordStarts.push_back(record.first);
+
 	size_t thread_count = std::thread::hardware_concurrency();
 //	size_t thread_count = 1;
-	uint64_t chunk_size = genomeSize / thread_count;
-	uint64_t start = 0;
+	uint64_t kmer_count = genomeSize - from - 32;
+	uint64_t chunk_size = kmer_count / thread_count;
+	uint64_t start = from;
 
 	/*
-		Allocate the thread pool
+		Allocate the thread pool and the progress counters (which are sampled by the reporter thread)
 	*/
 	std::vector<std::thread> threads;
+	std::vector<progress_counter> progress(thread_count);
+	std::vector<uint64_t> skipped(thread_count);
+	for (size_t i = 0; i < thread_count; i++)
+		progress[i].total = i == thread_count - 1 ? kmer_count - chunk_size * i : chunk_size;
+	progress_reporter reporter(progress);
 
 	/*
 		Launch each thread
@@ -157,14 +190,28 @@ void index_kmers(char *genome, uint64_t genomeSize, std::vector<protected_vector
 	std::cout << "Launching " << thread_count << " threads each with " << chunk_size << " pieces\n";
 	for (size_t i = 0; i < thread_count - 1; i++)
 		{
-		threads.push_back(std::thread(index_kmers_thread, genome, start, chunk_size, std::ref(kmersMap), MASK));
+		threads.push_back(std::thread(worker, genome, start, chunk_size, std::ref(kmersMap), MASK, prefilter, std::cref(recordStarts), &progress[i], &skipped[i]));
 		start += chunk_size;
 		}
-	index_kmers_thread(genome, start, genomeSize - start - 32, kmersMap, MASK);
+	worker(genome, start, from + kmer_count - start, kmersMap, MASK, prefilter, recordStarts, &progress[thread_count - 1], &skipped[thread_count - 1]);
 
 	/*
 		Wait for each thread to terminate
 	*/
 	for (auto &thread : threads)
 		thread.join();
+
+	uint64_t total_skipped = 0;
+	for (uint64_t count : skipped)
+		total_skipped += count;
+	std::cout << "Skipped " << total_skipped << " of " << kmer_count << " windows spanning a record start or an ambiguous base" << std::endl;
+
+	if (!kmersMap.empty())
+		{
+		run_statistics.add("index_threads", thread_count);
+		run_statistics.add("kmers_indexed", kmer_count - total_skipped);
+		run_statistics.add("kmers_skipped", total_skipped);
+		}
+
+	return total_skipped;
 	}
@@ -0,0 +1,123 @@
+/*
+	INDEXMETADATA.CPP
+	-----------------
+	indexReference
+
+	How an index was built, so that whatever reads the index computes buckets the same way.
+*/
+#include <stdlib.h>
+
+#include <fstream>
+#include <iostream>
+
+#include "indexMetadata.hpp"
+
+/*
+	INDEXMETADATAFILENAME()
+	-----------------------
+*/
+std::string indexMetadataFilename(const std::string &baseName)
+	{
+	return baseName + "_32_Metadata.idx";
+	}
+
+/*
+	NUMBER_FROM_STRING()
+	--------------------
+*/
+static bool number_from_string(const std::string &value, uint32_t &number)
+	{
+	char *end;
+	unsigned long parsed = strtoul(value.c_str(), &end, 10);
+	if (value.empty() || *end != '\0' || parsed > UINT32_MAX)
+		return false;
+
+	number = static_cast<uint32_t>(parsed);
+	return true;
+	}
+
+/*
+	INDEX_METADATA::SERIALIZE()
+	---------------------------
+*/
+bool index_metadata::serialize(const std::string &filename) const
+	{
+	std::ofstream outputFile(filename);
+	if (!outputFile.is_open())
+		return false;
+
+	outputFile << "genome_format " << genome_format << "\n";
+	outputFile << "hash " << hash_function_name(hash) << "\n";
+	outputFile << "layout " << bucket_layout_name(layout) << "\n";
+	if (prefilter_bits != 0)
+		outputFile << "prefilter_bits " << prefilter_bits << "\n";
+	if (repeat_threshold != 0)
+		{
+		outputFile << "repeat_threshold " << repeat_threshold << "\n";
+		outputFile << "repeat_mode " << (repeat_mask ? "mask" : "positions") << "\n";
+		}
+
+	return outputFile.good();
+	}
+
+/*
+	INDEX_METADATA::DESERIALIZE()
+	-----------------------------
+	Unknown keys are skipped (so that older programs can read newer metadata), unknown values are an error.  Every key not
+	in the file takes its default, but genome_format, which older programs did not write, is then 0 (not known).
+*/
+bool index_metadata::deserialize(const std::string &filename)
+	{
+	std::ifstream inputFile(filename);
+	std::string key;
+	std::string value;
+
+	*this = index_metadata();
+	genome_format = 0;
+	if (!inputFile.is_open())
+		return true;
+
+	while (inputFile >> key >> value)
+		if (key == "hash" && !hash_function_from_name(value, hash))
+			{
+			std::cerr << filename << ": unknown hash function " << value << std::endl;
+			return false;
+			}
+		else if (key == "layout" && !bucket_layout_from_name(value, layout))
+			{
+			std::cerr << filename << ": unknown bucket layout " << value << std::endl;
+			return false;
+			}
+		else if ((key == "genome_format" && !number_from_string(value, genome_format)) || (key == "prefilter_bits" && !number_from_string(value, prefilter_bits)) || (key == "repeat_threshold" && !number_from_string(value, repeat_threshold)))
+			{
+			std::cerr << filename << ": " << key << " is not a number (" << value << ")" << std::endl;
+			return false;
+			}
+		else if (key == "repeat_mode")
+			{
+			if (value != "mask" && value != "positions")
+				{
+				std::cerr << filename << ": unknown repeat mode " << value << std::endl;
+				return false;
+				}
+			repeat_mask = value == "mask";
+			}
+
+	return true;
+	}
+
+/*
+	INDEX_METADATA::GENOME_FORMAT_SUPPORTED()
+	-----------------------------------------
+*/
+bool index_metadata::genome_format_supported(const std::string &baseName) const
+	{
+	if (genome_format == GENOME_FORMAT)
+		return true;
+
+	if (genome_format == 0)
+		std::cerr << "The index of " << baseName << " does not record its genome format, so its positions may not match the FASTA.  Rebuild it." << std::endl;
+	else
+		std::cerr << "The index of " << baseName << " has genome format " << genome_format << ", this program reads format " << GENOME_FORMAT << ".  Rebuild it." << std::endl;
+	return false;
+	}
@@ -0,0 +1,292 @@
+/*
+	INSTRUMENTATION.CPP
+	-------------------
+	indexReference
+
+	Low overhead instrumentation: per-thread progress counters sampled by a reporter thread, scoped phase timers with optional
+	hardware performance counters, and a JSON report of it all.
+*/
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+	#include <sys/ioctl.h>
+	#include <sys/syscall.h>
+	#include <linux/perf_event.h>
+#endif
+
+#include <fstream>
+#include <iostream>
+
+#include "instrumentation.hpp"
+
+stats_report run_statistics;
+
+const char *hardware_counters::name[hardware_counters::COUNTERS] = {"cycles", "llc_misses", "branch_misses"};
+
+/*
+	PROGRESS_REPORTER::PROGRESS_REPORTER()
+	--------------------------------------
+*/
+progress_reporter::progress_reporter(std::vector<progress_counter> &counters, uint64_t update_interval) :
+	counters(counters),
+	update_interval(update_interval),
+	finished(false)
+	{
+	reporter = std::thread(&progress_reporter::report, this);
+	}
+
+/*
+	PROGRESS_REPORTER::~PROGRESS_REPORTER()
+	---------------------------------------
+*/
+progress_reporter::~progress_reporter()
+	{
+		{
+		std::lock_guard<std::mutex> guard(lock);
+		finished = true;
+		}
+	wake.notify_one();
+	reporter.join();
+	}
+
+/*
+	PROGRESS_REPORTER::REPORT()
+	---------------------------
+	Sample the counters every 100ms until told to stop.
+*/
+void progress_reporter::report(void)
+	{
+	auto start = std::chrono::steady_clock::now();
+	uint64_t next_percent = 0;
+	uint64_t total = 0;
+
+	for (const auto &counter : counters)
+		total += counter.total;
+
+	std::unique_lock<std::mutex> guard(lock);
+	do
+		{
+		uint64_t done = 0;
+		for (const auto &counter : counters)
+			done += counter.done.load(std::memory_order_relaxed);
+
+		uint64_t percent = total == 0 ? 100 : done * 100 / total;
+		if (percent >= next_percent && percent < 100)
+			{
+			auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+			std::cout << "progress:" << percent << " (" << duration << " miliseconds)\n";
+			next_percent = (percent / update_interval + 1) * update_interval;
+			}
+		}
+	while (!wake.wait_for(guard, std::chrono::milliseconds(100), [this]() { return finished; }));
+	}
+
+#ifdef __linux__
+	/*
+		PERF_EVENT_OPEN()
+		-----------------
+	*/
+	static int perf_event_open(uint32_t type, uint64_t config)
+		{
+		struct perf_event_attr attributes;
+
+		memset(&attributes, 0, sizeof(attributes));
+		attributes.size = sizeof(attributes);
+		attributes.type = type;
+		attributes.config = config;
+		attributes.disabled = 1;
+		attributes.inherit = 1;
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+
+		return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+		}
+#endif
+
+/*
+	HARDWARE_COUNTERS::HARDWARE_COUNTERS()
+	--------------------------------------
+*/
+hardware_counters::hardware_counters()
+	{
+#ifdef __linux__
+	fd[CYCLES] = perf_event_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	fd[LLC_MISSES] = perf_event_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+	fd[BRANCH_MISSES] = perf_event_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#else
+	for (size_t counter = 0; counter < COUNTERS; counter++)
+		fd[counter] = -1;
+#endif
+	}
+
+/*
+	HARDWARE_COUNTERS::~HARDWARE_COUNTERS()
+	---------------------------------------
+*/
+hardware_counters::~hardware_counters()
+	{
+	for (size_t counter = 0; counter < COUNTERS; counter++)
+		if (fd[counter] >= 0)
+			close(fd[counter]);
+	}
+
+/*
+	HARDWARE_COUNTERS::AVAILABLE()
+	------------------------------
+*/
+bool hardware_counters::available(void) const
+	{
+	for (size_t counter = 0; counter < COUNTERS; counter++)
+		if (fd[counter] >= 0)
+			return true;
+
+	return false;
+	}
+
+/*
+	HARDWARE_COUNTERS::START()
+	--------------------------
+*/
+void hardware_counters::start(void)
+	{
+#ifdef __linux__
+	for (size_t counter = 0; counter < COUNTERS; counter++)
+		if (fd[counter] >= 0)
+			{
+			ioctl(fd[counter], PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd[counter], PERF_EVENT_IOC_ENABLE, 0);
+			}
+#endif
+	}
+
+/*
+	HARDWARE_COUNTERS::READ()
+	-------------------------
+*/
+void hardware_counters::read(uint64_t *values)
+	{
+	for (size_t counter = 0; counter < COUNTERS; counter++)
+		{
+		values[counter] = 0;
+#ifdef __linux__
+		if (fd[counter] >= 0)
+			{
+			ioctl(fd[counter], PERF_EVENT_IOC_DISABLE, 0);
+			if (::read(fd[counter], &values[counter], sizeof(values[counter])) != sizeof(values[counter]))
+				values[counter] = 0;
+			}
+#endif
+		}
+	}
+
+/*
+	STATS_REPORT::ADD_PHASE()
+	-------------------------
+*/
+void stats_report::add_phase(const phase_record &phase)
+	{
+	std::lock_guard<std::mutex> guard(lock);
+	phases.push_back(phase);
+	}
+
+/*
+	STATS_REPORT::ADD()
+	-------------------
+	Add value to the named counter.
+*/
+void stats_report::add(const std::string &counter, uint64_t value)
+	{
+	std::lock_guard<std::mutex> guard(lock);
+	counters[counter] += value;
+	}
+
+/*
+	STATS_REPORT::WRITE_JSON()
+	--------------------------
+*/
+bool stats_report::write_json(const std::string &filename)
+	{
+	std::lock_guard<std::mutex> guard(lock);
+	std::ofstream out(filename);
+	if (!out)
+		{
+		std::cerr << "Error opening the file: " << filename << std::endl;
+		return false;
+		}
+
+	out << "{\n";
+	out << "  \"phases\": [\n";
+	for (size_t which = 0; which < phases.size(); which++)
+		{
+		const auto &phase = phases[which];
+		out << "    {\"name\": \"" << phase.name << "\", \"seconds\": " << phase.seconds;
+		if (phase.counted)
+			for (size_t counter = 0; counter < hardware_counters::COUNTERS; counter++)
+				out << ", \"" << hardware_counters::name[counter] << "\": " << phase.counters[counter];
+		out << "}" << (which + 1 == phases.size() ? "\n" : ",\n");
+		}
+	out << "  ],\n";
+
+	out << "  \"counters\": {";
+	for (auto counter = counters.begin(); counter != counters.end(); counter++)
+		out << (counter == counters.begin() ? "\n" : ",\n") << "    \"" << counter->first << "\": " << counter->second;
+	out << "\n  }\n";
+	out << "}\n";
+
+	return out.good();
+	}
+
+/*
+	PHASE_TIMER::PHASE_TIMER()
+	--------------------------
+*/
+phase_timer::phase_timer(const std::string &name) :
+	name(name),
+	counters(nullptr),
+	stopped(false)
+	{
+	if (run_statistics.use_hardware_counters)
+		{
+		counters = new hardware_counters;
+		counters->start();
+		}
+	start = std::chrono::steady_clock::now();
+	}
+
+/*
+	PHASE_TIMER::~PHASE_TIMER()
+	---------------------------
+*/
+phase_timer::~phase_timer()
+	{
+	stop();
+	delete counters;
+	}
+
+/*
+	PHASE_TIMER::STOP()
+	-------------------
+	Stop timing (only the first call counts) and return the duration in seconds.
+*/
+double phase_timer::stop(void)
+	{
+	if (stopped)
+		return 0;
+	stopped = true;
+
+	phase_record phase;
+	phase.name = name;
+	phase.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	phase.counted = counters != nullptr && counters->available();
+	if (counters != nullptr)
+		counters->read(phase.counters);
+	else
+		memset(phase.counters, 0, sizeof(phase.counters));
+
+	int minutes = static_cast<int>(phase.seconds / 60);
+	std::cout << name << " time: " << minutes << " min " << phase.seconds - minutes * 60 << " sec" << std::endl;
+
+	run_statistics.add_phase(phase);
+	return phase.seconds;
+	}
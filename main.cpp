@@ -7,13 +7,23 @@
 */
 
 #include <map>
-#include <thread>
 #include <chrono>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <iomanip>
 #include <sstream>
 #include <fstream>
 #include <iostream>
 
+#include "hash.hpp"
 #include "indexGenome.hpp"
+#include "indexMetadata.hpp"
+#include "encode_kmer_2bit.h"
+#include "shardIndex.hpp"
+#include "repeatBuckets.hpp"
+#include "referenceCollection.hpp"
+#include "instrumentation.hpp"
 #include "protected_vector.hpp"
 #include "serialiseKmersMap.hpp"
 
@@ -21,7 +31,18 @@ std::vector<std::string> sampleSequences;
 std::vector<std::string> fileNames;
 
 // some global default values (overide with cmd line arguments)
-std::string REFERENCE = ""; // file name for reference file to match against
+std::string REFERENCE = ""; // file name for reference file to match against (the first if there are several), names the index
+std::vector<std::string> REFERENCES; // every -reference (file, directory or @manifest)
+std::string APPEND = ""; // file name of new sequences to append to an existing REFERENCE index
+size_t READERS = 0; // number of threads loading the reference files (0 = one per core)
+size_t SHARDS = 1; // number of hash-range shards to split the index into
+uint32_t PREFILTER_BITS = 0; // bits per k-mer in the absent k-mer prefilter (0 = no prefilter)
+uint32_t REPEAT_THRESHOLD = 0; // buckets with more positions than this are moved to the repeat table (0 = keep them all)
+bool REPEAT_MASK = false; // if true the repeat table keeps only the count of each repeat bucket, not its positions
+std::string STATS = ""; // file name for the JSON run statistics (phase times, counters)
+hash_function HASH = MURMUR_HASH; // bucket hash policy (recorded in the index metadata)
+bucket_layout LAYOUT = OFFSET_LAYOUT; // how the buckets are held in the Outer and Inner blobs (recorded in the index metadata)
+bool HASH_REPORT = false; // if true, report the bucket distribution and speed of each hash policy rather than building the index
 
 /*
 	WRITEMAPTOFILE()
@@ -42,13 +63,142 @@ void writeMapToFile(const std::string &filename, const std::map<uint32_t, std::s
 	outFile.close();
 	}
 
+/*
+	READMAPFROMFILE()
+	-----------------
+	Read a referenceIDMap written by writeMapToFile() (one "<offset> <ID line>" per line).
+*/
+bool readMapFromFile(const std::string &filename, std::map<uint32_t, std::string> &referenceIDMap)
+	{
+	std::ifstream inFile(filename);
+	if (!inFile)
+		{
+		std::cerr << "Error opening the file: " << filename << std::endl;
+		return false;
+		}
+
+	std::string line;
+	while (std::getline(inFile, line))
+		{
+		size_t space = line.find(' ');
+		if (space == std::string::npos)
+			continue;
+		referenceIDMap[std::stoul(line.substr(0, space))] = line.substr(space + 1) + "\n";
+		}
+
+	return true;
+	}
+
+/*
+	REPORTHUGEPAGES()
+	-----------------
+*/
+void reportHugePages(void)
+	{
+	uint64_t allocated;
+	uint64_t huge;
+
+	huge_pages::coverage(allocated, huge);
+	std::cout << "Huge page coverage: " << huge / (1024 * 1024) << " MB of " << allocated / (1024 * 1024) << " MB" << (huge_pages::enabled ? "" : " (huge pages disabled)") << std::endl;
+	huge_pages::report(std::cout);
+
+	run_statistics.add("huge_page_candidate_bytes", allocated);
+	run_statistics.add("huge_page_bytes", huge);
+	}
+
+/*
+	HASHSAMPLE()
+	------------
+	Hash each k-mer in sample rounds times, returning the sum so that the work cannot be thrown away.
+*/
+template <typename HASH>
+uint64_t hashSample(const std::vector<uint64_t> &sample, uint64_t rounds)
+	{
+	uint64_t total = 0;
+	for (uint64_t round = 0; round < rounds; round++)
+		for (uint64_t kmer : sample)
+			total += HASH::hash(kmer);
+	return total;
+	}
+
+/*
+	REPORTHASHFUNCTIONS()
+	---------------------
+	Index the genome with each hash policy and report the bucket occupancy, the skew (p99 and max bucket length) and the speed
+	of each, so that the fastest hash with acceptable skew can be chosen with -hash.
+*/
+void reportHashFunctions(char *genome, uint64_t genomeSize, const std::map<uint32_t, std::string> &referenceIDMap, int numBitsToKeep, uint32_t MASK)
+	{
+	if (genomeSize < 64)
+		{
+		std::cerr << "The genome is too small to compare hash functions" << std::endl;
+		return;
+		}
+
+	/*
+		A cache-resident sample of the canonical k-mers, for timing the hash on its own
+	*/
+	std::vector<uint64_t> sample(std::min<uint64_t>(genomeSize - 32, 1 << 20));
+	for (uint64_t pos = 0; pos < sample.size(); pos++)
+		{
+		uint64_t kmer = encode_kmer_2bit::pack_32mer(genome + pos);
+		sample[pos] = kmer ^ encode_kmer_2bit::reverse_complement_32mer(kmer);
+		}
+	uint64_t rounds = std::max<uint64_t>(1, (genomeSize - 32) / sample.size());
+	uint64_t hashes = rounds * sample.size();
+
+	std::vector<std::string> rows;
+	for (int function = 0; function < HASH_FUNCTION_COUNT; function++)
+		{
+		hash_function hash = static_cast<hash_function>(function);
+		std::string name = hash_function_name(hash);
+
+		huge_page_vector<protected_vector<uint32_t>> kmersMap(pow(2, numBitsToKeep));
+		auto started = std::chrono::steady_clock::now();
+		index_kmers(genome, genomeSize, kmersMap, MASK, 0, nullptr, hash, &referenceIDMap);
+		double indexSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+		bucket_statistics statistics;
+		statistics.compute(kmersMap.size(), [&kmersMap](uint64_t bucket) { return kmersMap[bucket].size(); });
+
+		started = std::chrono::steady_clock::now();
+		volatile uint64_t sum = HASH_DISPATCH(hash, hashSample)(sample, rounds);
+		(void)sum;
+		double hashSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+		std::ostringstream row;
+		row << std::left << std::setw(16) << (hash == CRC32C_HASH && !crc32c_in_hardware() ? name + "*" : name) << std::right << std::fixed
+			<< std::setw(10) << std::setprecision(2) << statistics.occupied * 100.0 / statistics.buckets << "%"
+			<< std::setw(8) << statistics.percentile(99) << std::setw(8) << statistics.largest
+			<< std::setw(14) << std::setprecision(1) << (genomeSize - 32) / indexSeconds / 1e6
+			<< std::setw(14) << hashes / hashSeconds / 1e6;
+		rows.push_back(row.str());
+
+		run_statistics.add("hash_" + name + "_occupied_buckets", statistics.occupied);
+		run_statistics.add("hash_" + name + "_p99_bucket_length", statistics.percentile(99));
+		run_statistics.add("hash_" + name + "_max_bucket_length", statistics.largest);
+		run_statistics.add("hash_" + name + "_index_kmers_per_sec", static_cast<uint64_t>((genomeSize - 32) / indexSeconds));
+		run_statistics.add("hash_" + name + "_hashes_per_sec", static_cast<uint64_t>(hashes / hashSeconds));
+		}
+
+	std::cout << std::endl << "Hash policies over " << genomeSize - 32 << " k-mers in " << (MASK + 1ULL) << " buckets" << std::endl;
+	std::cout << std::left << std::setw(16) << "hash" << std::right << std::setw(11) << "occupied" << std::setw(8) << "p99" << std::setw(8) << "max" << std::setw(14) << "index Mk/s" << std::setw(14) << "hash Mops/s" << std::endl;
+	for (const auto &row : rows)
+		std::cout << row << std::endl;
+	if (!crc32c_in_hardware())
+		std::cout << "* software CRC32C, this build does not have the CRC32 instruction" << std::endl;
+	}
+
 /*
 	GETBASENAME()
 	-------------
 */
 std::string getBaseName(const std::string& filePath)
 	{
-	std::stringstream ss(filePath);
+	std::string path = filePath.size() > 1 && filePath[0] == '@' ? filePath.substr(1) : filePath;		// a manifest
+	while (path.size() > 1 && path.back() == '/')		// a directory
+		path.pop_back();
+	std::stringstream ss(path);
 	std::string baseName;
 	std::getline(ss, baseName, '.');
 	return baseName;
@@ -61,15 +211,25 @@ std::string getBaseName(const std::string& filePath)
 void getReference(std::string inputFile)
 	{
 	std::map<uint32_t, std::string> referenceIDMap;
+	std::map<uint32_t, std::string> fileIDMap;
 	char *genome = nullptr;
 	uint32_t MASK = 0;
 
     /*
 		load the genome
 	*/
-    auto start = std::chrono::steady_clock::now();
+    phase_timer building("Building");
     uint64_t genomeSize;
-    genome = load_genome_file(REFERENCE, referenceIDMap, genomeSize);
+	for (const auto &reference : REFERENCES)
+		if (!list_reference_files(reference, fileNames))
+			exit(1);
+	if (fileNames.empty())
+		{
+		std::cerr << "No reference files found in " << inputFile << std::endl;
+		exit(1);
+		}
+    genome = load_genome_files(fileNames, referenceIDMap, fileIDMap, genomeSize, READERS);
+	run_statistics.add("reference_files", fileNames.size());
 
 	/*
 		Calculate the number of elements to reserve in kmersIndex based on genome size
@@ -77,77 +237,154 @@ void getReference(std::string inputFile)
 	int numBitsToKeep = ::ceil(::log2(genomeSize));
 	MASK = (numBitsToKeep == 32) ? UINT32_MAX : (1 << numBitsToKeep) - 1;
 	std::cout << "Keeping " << numBitsToKeep << " bits in kmerHash" << std::endl;
-	std::vector<protected_vector<uint32_t>> kmersMap(pow(2, numBitsToKeep));
+	if (HASH_REPORT)
+		{
+		building.stop();
+		reportHashFunctions(genome, genomeSize, referenceIDMap, numBitsToKeep, MASK);
+		huge_pages::release(genome);
+		return;
+		}
+	huge_page_vector<protected_vector<uint32_t>> kmersMap(pow(2, numBitsToKeep));
 
 	/*
 		Now index
 	*/
-    index_kmers(genome, genomeSize, kmersMap, MASK);
-
-    auto end = std::chrono::steady_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    int minutes = (int) duration.count() / (1000 * 60);
-    float seconds = ((duration.count() - minutes * 1000 * (float) 60))/1000;
-    std::cout << "Building time: " << minutes << " min " << seconds << " sec" << std::endl;
+	std::unique_ptr<blocked_bloom_filter> prefilter;
+	if (PREFILTER_BITS != 0)
+		prefilter.reset(new blocked_bloom_filter(genomeSize, PREFILTER_BITS));
+    uint64_t skipped = index_kmers(genome, genomeSize, kmersMap, MASK, 0, prefilter.get(), HASH, &referenceIDMap);
+	building.stop();
+	run_statistics.add("genome_bases", genomeSize);
+	reportHugePages();
 
 	/*
 		Compute global index statistics including the number of "words", number of unique "words" (including colisions), et.
 	*/
-	uint64_t kmerCount = genomeSize - 32;
-	uint64_t kmersInMap = 0;
-	for (int i = 0; i < kmersMap.size(); i++)
-		if (!kmersMap[i].empty())
-			kmersInMap++;
-	std::cout  << "Map size " << kmersMap.size() << ", kmersCount " << kmerCount << ", kmers in Map " << kmersInMap << std::endl;
+	uint64_t kmerCount = genomeSize - 32 - skipped;
+	bucket_statistics statistics;
+	statistics.compute(kmersMap.size(), [&kmersMap](uint64_t bucket) { return kmersMap[bucket].size(); });
+	std::cout  << "Map size " << kmersMap.size() << ", kmersCount " << kmerCount << ", kmers in Map " << statistics.occupied << std::endl;
+	statistics.report(std::cout, REPEAT_THRESHOLD);
+
+	/*
+		Move the high-frequency buckets out of the index and into the repeat table
+	*/
+	repeat_table repeats;
+	if (REPEAT_THRESHOLD != 0)
+		{
+		std::string repeatsFilename = repeatTableFilename(getBaseName(inputFile));
+		repeats.extract(kmersMap, REPEAT_THRESHOLD, !REPEAT_MASK);
+		std::cout << "Serialising " << repeats.entries.size() << " repeat buckets (" << (REPEAT_MASK ? "masked" : "with positions") << ") to " << repeatsFilename << std::endl;
+		repeats.serialize(repeatsFilename);
+		}
+	else
+		remove(repeatTableFilename(getBaseName(inputFile)).c_str());		// lookups would take one left by an earlier build as this index's
 
     /*
 		Serialize the map
 	*/
-    start = std::chrono::steady_clock::now();
     std::string outerMapFilename = getBaseName(inputFile) + "_32_OuterBlob.idx";
     std::string innerMapFilename = getBaseName(inputFile) + "_32_InnerBlob.idx";
     std::string genomeFilename = getBaseName(inputFile) + "_genome.idx";
     std::string refIDFilename = getBaseName(inputFile) + "_refID.idx";
+    std::string fileIDFilename = getBaseName(inputFile) + "_fileID.idx";
 
+	phase_timer serialisingGenome("Serialising genome");
     std::cout << "Serialising genome to " << genomeFilename << " and " << innerMapFilename << std::endl;
     writeTextBlobToFile(genome, genomeSize, genomeFilename);
-    end = std::chrono::steady_clock::now();
-    duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    minutes = (int) duration.count() / (1000 * 60);
-    seconds = ((duration.count() - minutes * 1000 * (float) 60))/1000;
-    std::cout << "Serialising genome time: " << minutes << " min " << seconds << " sec" << std::endl;
-
-    std::cout << "Serialising map to " << outerMapFilename << " and " << innerMapFilename << std::endl;
-    serializeMap(kmersMap, innerMapFilename, outerMapFilename);
-    end = std::chrono::steady_clock::now();
-    duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    minutes = (int) duration.count() / (1000 * 60);
-    seconds = ((duration.count() - minutes * 1000 * (float) 60))/1000;
-    std::cout << "Serialising Maps time: " << minutes << " min " << seconds << " sec" << std::endl;
+	serialisingGenome.stop();
+
+	phase_timer serialisingMaps("Serialising Maps");
+	removeShards(getBaseName(inputFile));		// an earlier build's shards (or its manifest) would be taken as this index's
+    if (SHARDS > 1)
+		{
+		std::cout << "Serialising map to " << SHARDS << " shards listed in " << shardManifestFilename(getBaseName(inputFile)) << std::endl;
+		serializeShards(kmersMap, getBaseName(inputFile), SHARDS, LAYOUT);
+		remove(outerMapFilename.c_str());
+		remove(innerMapFilename.c_str());
+		}
+	else
+		{
+		std::cout << "Serialising map to " << outerMapFilename << " and " << innerMapFilename << std::endl;
+		serializeMap(kmersMap, innerMapFilename, outerMapFilename, LAYOUT);
+		}
+	serialisingMaps.stop();
     
     std::cout << "Serialising ReferenceIDMap" << std::endl;
     writeMapToFile(refIDFilename, referenceIDMap);
+    writeMapToFile(fileIDFilename, fileIDMap);
+
+	index_metadata metadata;
+	metadata.hash = HASH;
+	metadata.layout = LAYOUT;
+	metadata.prefilter_bits = PREFILTER_BITS;
+	metadata.repeat_threshold = REPEAT_THRESHOLD;
+	metadata.repeat_mask = REPEAT_MASK;
+	metadata.serialize(indexMetadataFilename(getBaseName(inputFile)));
+
+	if (prefilter)
+		{
+		std::string prefilterFilename = getBaseName(inputFile) + "_32_Prefilter.idx";
+		double fill = prefilter->fill_ratio();
+		std::cout << "Serialising prefilter to " << prefilterFilename << " (" << prefilter->size_in_bytes() << " bytes, " << fill * 100 << "% full, ~" << ::pow(fill, 8) * 100 << "% false positives)" << std::endl;
+		prefilter->serialize(prefilterFilename);
+		}
+	else
+		remove((getBaseName(inputFile) + "_32_Prefilter.idx").c_str());		// lookups would take one left by an earlier build as this index's
         
     // DeSerialize the genome
-    start = std::chrono::steady_clock::now();
+	phase_timer deserialisingGenome("DeSerialising genome");
     // Read the text blob from the file and directly assign to genome and textLength
     std::tie(genome, genomeSize) = readTextBlobFromFile(genomeFilename);
-    end = std::chrono::steady_clock::now();
-    duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    minutes = (int) duration.count() / (1000 * 60);
-    seconds = ((duration.count() - minutes * 1000 * (float) 60))/1000;
-    std::cout << "DeSerialising genome time: " << minutes << " min " << seconds << " sec" << std::endl;
+	deserialisingGenome.stop();
 
     // DeSerialize the map
-    start = std::chrono::steady_clock::now();
-    std::vector<uint32_t> innerMapBlob;
-    std::vector<uint32_t> outerMapBlob;
-    deserializeMap(innerMapFilename, outerMapFilename, innerMapBlob, outerMapBlob);
-    end = std::chrono::steady_clock::now();
-    duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-    minutes = (int) duration.count() / (1000 * 60);
-    seconds = ((duration.count() - minutes * 1000 * (float) 60))/1000;
-    std::cout << "DeSerialising Maps time: " << minutes << " min " << seconds << " sec" << std::endl;
+	phase_timer deserialisingMaps("DeSerialising Maps");
+    huge_page_vector<uint32_t> innerMapBlob;
+    huge_page_vector<uint32_t> outerMapBlob;
+    if (SHARDS > 1)
+		{
+		/*
+			Round trip a sample of the genome's k-mers through the shards, each served by its own process, and check that each
+			comes back with the bucket it was put in (or, if the bucket went to the repeat table, with the positions or count the
+			table has for it)
+		*/
+		shard_router router(getBaseName(inputFile), true);
+		std::vector<uint64_t> canonicalKmers;
+		for (uint64_t position = 0; position + 32 <= genomeSize; position += std::max<uint64_t>(1, genomeSize / 100000))
+			{
+			uint64_t kmer = encode_kmer_2bit::pack_32mer(genome + position);
+			canonicalKmers.push_back(kmer ^ encode_kmer_2bit::reverse_complement_32mer(kmer));
+			}
+
+		phase_timer roundTrip("Shard round trip");
+		std::vector<std::vector<uint32_t>> postings;
+		std::vector<uint32_t> masked;
+		router.lookup(canonicalKmers, postings, &masked);
+		roundTrip.stop();
+
+		uint64_t mismatches = 0;
+		for (size_t which = 0; which < canonicalKmers.size(); which++)
+			{
+			uint32_t bucket = kmerHash(HASH, canonicalKmers[which]) & MASK;
+			std::vector<uint32_t> expected(kmersMap[bucket].begin(), kmersMap[bucket].end());
+			uint32_t expectedMasked = 0;
+			if (const repeat_bucket *repeat = repeats.find(bucket))
+				{
+				expected.assign(repeats.positions.begin() + repeat->offset, repeats.positions.begin() + repeat->offset + repeat->stored);
+				expectedMasked = repeat->stored == 0 ? repeat->count : 0;
+				}
+			std::sort(expected.begin(), expected.end());
+			std::sort(postings[which].begin(), postings[which].end());
+			mismatches += postings[which] != expected || masked[which] != expectedMasked;
+			}
+		std::cout << "Shard round trip: " << canonicalKmers.size() << " k-mers, " << mismatches << " mismatches" << std::endl;
+		if (mismatches != 0)
+			exit(1);
+		}
+	else
+		deserializeMap(innerMapFilename, outerMapFilename, innerMapBlob, outerMapBlob, LAYOUT);
+	deserialisingMaps.stop();
 
 	/*  SANITY TEST CODE, ignore
 		// test the index
@@ -173,6 +410,199 @@ void getReference(std::string inputFile)
 	*/
 	}
 
+/*
+	APPENDREFERENCE()
+	-----------------
+	Append the sequences in appendFile (a file, directory or @manifest) to the existing index of inputFile.  Only the new positions are indexed, they are then
+	merged onto the end of each bucket of the existing Inner/Outer blobs.  If the combined genome needs more hash bits than the
+	existing index then the whole index is rebuilt.
+*/
+void appendReference(std::string inputFile, std::string appendFile)
+	{
+	std::string outerMapFilename = getBaseName(inputFile) + "_32_OuterBlob.idx";
+	std::string innerMapFilename = getBaseName(inputFile) + "_32_InnerBlob.idx";
+	std::string genomeFilename = getBaseName(inputFile) + "_genome.idx";
+	std::string refIDFilename = getBaseName(inputFile) + "_refID.idx";
+	std::string fileIDFilename = getBaseName(inputFile) + "_fileID.idx";
+
+	if (std::ifstream(shardManifestFilename(getBaseName(inputFile))))
+		{
+		std::cerr << "Cannot append to the sharded index of " << inputFile << ", rebuild it from all the references with -shards instead" << std::endl;
+		exit(1);
+		}
+
+	/*
+		Load the existing index
+	*/
+	phase_timer building("Building");
+	char *oldGenome;
+	uint64_t oldGenomeSize;
+	std::tie(oldGenome, oldGenomeSize) = readTextBlobFromFile(genomeFilename);
+	std::map<uint32_t, std::string> referenceIDMap;
+	if (oldGenome == nullptr || !readMapFromFile(refIDFilename, referenceIDMap))
+		{
+		std::cerr << "Failed to read the existing index of " << inputFile << std::endl;
+		exit(1);
+		}
+
+	/*
+		The new k-mers must be hashed (and their buckets laid out) the same way as the existing ones
+	*/
+	index_metadata metadata;
+	if (!metadata.deserialize(indexMetadataFilename(getBaseName(inputFile))) || !metadata.genome_format_supported(getBaseName(inputFile)))
+		exit(1);
+	if (metadata.hash != HASH)
+		std::cout << "Using the existing index's " << hash_function_name(metadata.hash) << " hash" << std::endl;
+	if (metadata.layout != LAYOUT)
+		std::cout << "Using the existing index's " << bucket_layout_name(metadata.layout) << " bucket layout" << std::endl;
+
+	huge_page_vector<uint32_t> innerMapBlob;
+	huge_page_vector<uint32_t> outerMapBlob;
+	if (!deserializeMap(innerMapFilename, outerMapFilename, innerMapBlob, outerMapBlob, metadata.layout))
+		exit(1);
+
+	/*
+		Load the new sequences and place them after the existing genome
+	*/
+	std::vector<std::string> appendFiles;
+	if (!list_reference_files(appendFile, appendFiles))
+		exit(1);
+	if (appendFiles.empty())
+		{
+		std::cerr << "No files to append found in " << appendFile << std::endl;
+		exit(1);
+		}
+	std::map<uint32_t, std::string> appendIDMap;
+	std::map<uint32_t, std::string> appendFileIDMap;
+	uint64_t appendSize;
+	char *appendGenome = load_genome_files(appendFiles, appendIDMap, appendFileIDMap, appendSize, READERS);
+
+	uint64_t genomeSize = oldGenomeSize + appendSize;
+	if (genomeSize > UINT32_MAX)
+		{
+		std::cerr << "Appending " << appendFile << " would make the reference larger than 4GB" << std::endl;
+		exit(1);
+		}
+	char *genome = static_cast<char *>(huge_pages::allocate(genomeSize + 1));
+	memcpy(genome, oldGenome, oldGenomeSize);
+	memcpy(genome + oldGenomeSize, appendGenome, appendSize);
+	genome[genomeSize] = '\0';
+	delete [] oldGenome;
+	huge_pages::release(appendGenome);
+
+	for (const auto &entry : appendIDMap)
+		referenceIDMap[entry.first + oldGenomeSize] = entry.second;
+
+	/*
+		An index built before the file map was kept came from a single file
+	*/
+	std::map<uint32_t, std::string> fileIDMap;
+	if (!std::ifstream(fileIDFilename) || !readMapFromFile(fileIDFilename, fileIDMap))
+		fileIDMap[0] = inputFile + "\n";
+	for (const auto &entry : appendFileIDMap)
+		fileIDMap[entry.first + oldGenomeSize] = entry.second;
+
+	/*
+		The bucket count depends on the genome size, if it has grown past the existing index then re-index it all
+	*/
+	int numBitsToKeep = ::ceil(::log2(genomeSize));
+	uint32_t MASK = (numBitsToKeep == 32) ? UINT32_MAX : (1 << numBitsToKeep) - 1;
+	huge_page_vector<protected_vector<uint32_t>> kmersMap(pow(2, numBitsToKeep));
+	uint64_t oldBuckets = bucket_count(outerMapBlob.size(), metadata.layout);
+	bool rebuild = kmersMap.size() != oldBuckets;
+	uint64_t from = rebuild || oldGenomeSize < 32 ? 0 : oldGenomeSize - 32;
+	/*
+		Keep the prefilter (if there is one) up to date, otherwise it would reject the new k-mers.  It was sized for the genome
+		it was built with, so once the genome outgrows it (or the index is rebuilt) a new one is sized for the whole genome
+		and refilled (an index from before prefilter_bits was recorded was sized for the existing genome).
+	*/
+	std::string prefilterFilename = getBaseName(inputFile) + "_32_Prefilter.idx";
+	std::unique_ptr<blocked_bloom_filter> prefilter(new blocked_bloom_filter);
+	if (!prefilter->deserialize(prefilterFilename))
+		prefilter.reset();
+	else
+		{
+		if (metadata.prefilter_bits == 0)
+			metadata.prefilter_bits = std::max<uint64_t>(1, prefilter->size_in_bytes() * 8 / std::max<uint64_t>(1, oldGenomeSize));
+		uint64_t capacity = prefilter->size_in_bytes() * 8 / metadata.prefilter_bits;
+		if (rebuild || genomeSize > capacity)
+			{
+			std::cout << "Resizing the prefilter for " << genomeSize << " bases (" << metadata.prefilter_bits << " bits per k-mer)" << std::endl;
+			prefilter.reset(new blocked_bloom_filter(genomeSize, metadata.prefilter_bits));
+			if (!rebuild && from != 0)
+				{
+				huge_page_vector<protected_vector<uint32_t>> noMap;
+				index_kmers(genome, from + 32, noMap, MASK, 0, prefilter.get(), metadata.hash, &referenceIDMap);
+				}
+			}
+		}
+
+	if (rebuild)
+		std::cout << "Keeping " << numBitsToKeep << " bits in kmerHash (was " << ::log2(oldBuckets) << "), rebuilding the whole index" << std::endl;
+	else
+		std::cout << "Appending " << appendSize << " bases to the existing " << oldGenomeSize << std::endl;
+
+	index_kmers(genome, genomeSize, kmersMap, MASK, from, prefilter.get(), metadata.hash, &referenceIDMap);
+	building.stop();
+	run_statistics.add("genome_bases", genomeSize);
+	run_statistics.add("appended_bases", appendSize);
+
+	/*
+		Serialise
+	*/
+	phase_timer serialising("Serialising");
+	std::cout << "Serialising genome to " << genomeFilename << std::endl;
+	writeTextBlobToFile(genome, genomeSize, genomeFilename);
+
+	/*
+		Keep the repeat table to the threshold it was built with.  A rebuild re-extracts it from the new index.  Otherwise new
+		positions in repeat buckets go to the table, as do the buckets the append takes over the threshold (whose existing
+		positions are then left out of the index).  An index from before the threshold was recorded can only absorb.
+	*/
+	std::string repeatsFilename = repeatTableFilename(getBaseName(inputFile));
+	repeat_table repeats;
+	bool hasRepeats = repeats.deserialize(repeatsFilename);
+	if (hasRepeats || metadata.repeat_threshold != 0)
+		{
+		if (rebuild && metadata.repeat_threshold != 0)
+			repeats.extract(kmersMap, metadata.repeat_threshold, !metadata.repeat_mask);
+		else if (rebuild)
+			std::cout << "Warning: " << repeatsFilename << " is out of date, re-index with -repeats to rebuild it" << std::endl;
+		else
+			{
+			repeats.absorb(kmersMap);
+			if (metadata.repeat_threshold != 0)
+				repeats.extract_grown(kmersMap, metadata.repeat_threshold, !metadata.repeat_mask, [&](uint64_t bucket, const uint32_t *&positions, uint32_t scratch[2])
+					{
+					return bucket_positions(innerMapBlob.data(), innerMapBlob.size(), outerMapBlob.data(), outerMapBlob.size(), bucket, metadata.layout, positions, scratch);
+					});
+			}
+		std::cout << "Serialising " << repeats.entries.size() << " repeat buckets to " << repeatsFilename << std::endl;
+		repeats.serialize(repeatsFilename);
+		}
+
+	std::cout << "Serialising map to " << outerMapFilename << " and " << innerMapFilename << std::endl;
+	if (rebuild)
+		serializeMap(kmersMap, innerMapFilename, outerMapFilename, metadata.layout);
+	else
+		appendToSerializedMap(innerMapBlob, outerMapBlob, kmersMap, innerMapFilename, outerMapFilename, metadata.layout, &repeats);
+
+	std::cout << "Serialising ReferenceIDMap" << std::endl;
+	writeMapToFile(refIDFilename, referenceIDMap);
+	writeMapToFile(fileIDFilename, fileIDMap);
+	metadata.serialize(indexMetadataFilename(getBaseName(inputFile)));
+
+	if (prefilter)
+		{
+		std::cout << "Serialising prefilter to " << prefilterFilename << " (" << prefilter->fill_ratio() * 100 << "% full)" << std::endl;
+		prefilter->serialize(prefilterFilename);
+		}
+	serialising.stop();
+
+	reportHugePages();
+	huge_pages::release(genome);
+	}
+
 /*
 	INITIALISE()
 	------------
@@ -181,8 +611,18 @@ void intialise(int argc, char *argv[])
 	{
 	if ((argc <= 1) || strcmp(argv[1], "-help") == 0)
 		{
-		std::cout << "Usage:  " << argv[0] << " -reference <reference_filename>\n";
+		std::cout << "Usage:  " << argv[0] << " -reference <reference_filename> [-readers <count>] [-append <new_sequences_filename>] [-shards <count>] [-prefilter <bits_per_kmer>] [-repeats <max_bucket_length>] [-repeatMode table|mask] [-stats <filename.json>] [-hardwareCounters yes|no] [-hugePages yes|no] [-hash murmur|xor|multiplyShift|crc32c|wyhash] [-hashReport yes|no] [-layout offsets|inline]\n";
 		std::cout << "example:" << argv[0] << " -reference CutibacteriumGenome.fasta\n";
+		std::cout << "        " << "-reference can be a FASTA file, a directory of them, or @<manifest> listing one per line, and can be given more than once\n";
+		std::cout << "        " << "-readers sets the number of threads loading the reference files (default one per core)\n";
+		std::cout << "        " << "-append adds the sequences to the existing index of the reference rather than rebuilding it\n";
+		std::cout << "        " << "-shards splits the index into <count> shards, each covering a contiguous range of the kmerHash space\n";
+		std::cout << "        " << "-prefilter builds a Bloom filter of the k-mers (10 bits per k-mer is about 1% false positives)\n";
+		std::cout << "        " << "-repeats moves buckets longer than <max_bucket_length> into a separate repeat table, -repeatMode mask keeps only their counts\n";
+		std::cout << "        " << "-stats writes the phase times and counters as JSON, -hardwareCounters yes adds cycles, LLC misses and branch misses per phase\n";
+		std::cout << "        " << "-hash chooses the bucket hash (default murmur), -hashReport yes indexes with each and reports their bucket skew and speed instead of writing the index\n";
+		std::cout << "        " << "-layout inline holds buckets of one or two positions in the OuterBlob itself (default offsets, every bucket in the InnerBlob)\n";
+		std::cout << "        " << "-hugePages no keeps the index and genome off huge pages (they are used, if available, by default)\n";
 		exit(0);
 		}
 
@@ -199,13 +639,63 @@ void intialise(int argc, char *argv[])
 
 		// Process the command line option
 		if (arg == "-reference")
-			REFERENCE = value;
+			{
+			if (REFERENCE == "")
+				REFERENCE = value;
+			REFERENCES.push_back(value);
+			}
+		else if (arg == "-readers")
+			READERS = std::stoul(value);
+		else if (arg == "-append")
+			APPEND = value;
+		else if (arg == "-shards")
+			SHARDS = std::max(1, std::stoi(value));
+		else if (arg == "-prefilter")
+			PREFILTER_BITS = std::stoul(value);
+		else if (arg == "-repeats")
+			REPEAT_THRESHOLD = std::stoul(value);
+		else if (arg == "-repeatMode")
+			REPEAT_MASK = value == "mask";
+		else if (arg == "-stats")
+			STATS = value;
+		else if (arg == "-hardwareCounters")
+			run_statistics.use_hardware_counters = value == "yes";
+		else if (arg == "-hugePages")
+			huge_pages::enabled = value != "no";
+		else if (arg == "-hash")
+			{
+			if (!hash_function_from_name(value, HASH))
+				std::cerr << "Error: Unknown hash function: " << value << std::endl;
+			}
+		else if (arg == "-layout")
+			{
+			if (!bucket_layout_from_name(value, LAYOUT))
+				std::cerr << "Error: Unknown bucket layout: " << value << std::endl;
+			}
+		else if (arg == "-hashReport")
+			HASH_REPORT = value == "yes";
 		else
 			std::cerr << "Error: Unknown option: " << arg << std::endl;
 		}
 
 	std::cout << "indexReference run parameters\n";
 	std::cout << "reference: " << REFERENCE << "\n";
+	if (REFERENCES.size() > 1)
+		std::cout << "references: " << REFERENCES.size() << "\n";
+	if (APPEND != "")
+		std::cout << "append: " << APPEND << "\n";
+	if (SHARDS > 1)
+		std::cout << "shards: " << SHARDS << "\n";
+	if (HASH != MURMUR_HASH)
+		std::cout << "hash: " << hash_function_name(HASH) << "\n";
+	if (LAYOUT != OFFSET_LAYOUT)
+		std::cout << "layout: " << bucket_layout_name(LAYOUT) << "\n";
+	if (PREFILTER_BITS != 0)
+		std::cout << "prefilter: " << PREFILTER_BITS << " bits per k-mer\n";
+	if (run_statistics.use_hardware_counters && !hardware_counters().available())
+		std::cout << "hardware counters: not available (perf_event_open failed), only times will be reported\n";
+	if (REPEAT_THRESHOLD != 0)
+		std::cout << "repeats: buckets longer than " << REPEAT_THRESHOLD << (REPEAT_MASK ? " masked" : " moved to the repeat table") << "\n";
 	}
 
 /*
@@ -214,19 +704,25 @@ void intialise(int argc, char *argv[])
 */
 int main(int argc, char *argv[])
 	{
-	// Start the timer
-	auto startAll = std::chrono::steady_clock::now();
-
 	// set up KISS parameters
 	intialise(argc, argv);
-	getReference(REFERENCE); // load the reference collection index
+
+	// Start the timer
+	phase_timer total("Total");
+	if (APPEND != "")
+		appendReference(REFERENCE, APPEND); // add new sequences to an existing index
+	else
+		getReference(REFERENCE); // load the reference collection index
 
 	// report overall program duration
-	auto endAll = std::chrono::steady_clock::now();
-	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endAll - startAll);
-	int minutes = (int)duration.count() / (1000 * 60);
-	float seconds = ((duration.count() - minutes * 1000 * (float) 60))/1000;
-	std::cout << "\nTotal time: " << minutes << " min " << seconds << " sec" << std::endl;
+	std::cout << std::endl;
+	total.stop();
+
+	if (STATS != "")
+		{
+		std::cout << "Writing run statistics to " << STATS << std::endl;
+		run_statistics.write_json(STATS);
+		}
 
 	return 0;
 	}
\ No newline at end of file
@@ -0,0 +1,220 @@
+/*
+	MAPPEDINDEX.CPP
+	---------------
+	indexReference
+
+	Open an index by memory mapping its files, and warm it in the background.
+*/
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include "shardIndex.hpp"
+#include "mappedIndex.hpp"
+
+/*
+	MAPPED_FILE::OPEN()
+	-------------------
+*/
+bool mapped_file::open(const std::string &filename)
+	{
+	close();
+
+	int file = ::open(filename.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+
+	struct stat details;
+	bool mapped = fstat(file, &details) == 0;
+	if (mapped && details.st_size != 0)
+		{
+		void *memory = mmap(nullptr, details.st_size, PROT_READ, MAP_SHARED, file, 0);
+		if (memory == MAP_FAILED)
+			mapped = false;
+		else
+			{
+			address = memory;
+			length = details.st_size;
+			advise(MADV_RANDOM);		// lookups jump about, reading ahead of a fault only wastes I/O
+			}
+		}
+
+	::close(file);
+	return mapped;
+	}
+
+/*
+	MAPPED_FILE::CLOSE()
+	--------------------
+*/
+void mapped_file::close(void)
+	{
+	if (address != nullptr)
+		munmap(address, length);
+	address = nullptr;
+	length = 0;
+	}
+
+/*
+	MAPPED_FILE::ADVISE()
+	---------------------
+*/
+void mapped_file::advise(int advice) const
+	{
+	if (address != nullptr)
+		madvise(address, length, advice);
+	}
+
+/*
+	MAPPED_INDEX::OPEN()
+	--------------------
+*/
+bool mapped_index::open(const std::string &baseName)
+	{
+	if (!metadata.deserialize(indexMetadataFilename(baseName)) || !metadata.genome_format_supported(baseName))
+		return false;
+
+	if (std::ifstream(shardManifestFilename(baseName)))
+		{
+		std::cerr << baseName << " is a sharded index, open it with a shard_router" << std::endl;
+		return false;
+		}
+
+	for (const auto &file : {std::make_pair(&outer, "_32_OuterBlob.idx"), std::make_pair(&inner, "_32_InnerBlob.idx"), std::make_pair(&genome, "_genome.idx")})
+		if (!file.first->open(baseName + file.second))
+			{
+			std::cerr << "Failed to map " << baseName + file.second << std::endl;
+			return false;
+			}
+
+	if (metadata.layout == INLINE_LAYOUT && outer.size() % sizeof(uint64_t) != 0)
+		{
+		std::cerr << baseName << "_32_OuterBlob.idx is not an OuterBlob in the " << bucket_layout_name(metadata.layout) << " layout" << std::endl;
+		return false;
+		}
+
+	prefilter.reset(new blocked_bloom_filter);
+	if (!prefilter->deserialize(baseName + "_32_Prefilter.idx"))
+		prefilter.reset();
+	repeats.reset(new repeat_table);
+	if (!repeats->deserialize(repeatTableFilename(baseName)))
+		repeats.reset();
+
+	return true;
+	}
+
+/*
+	MAPPED_INDEX::VIEW()
+	--------------------
+*/
+index_view mapped_index::view(void) const
+	{
+	index_view view;
+
+	view.outer = reinterpret_cast<const uint32_t *>(outer.data());
+	view.outer_size = outer.size() / sizeof(uint32_t);
+	view.inner = reinterpret_cast<const uint32_t *>(inner.data());
+	view.inner_size = inner.size() / sizeof(uint32_t);
+	view.genome = genome.data();
+	view.genome_size = genome.size();
+	view.hash = metadata.hash;
+	view.layout = metadata.layout;
+	view.prefilter = prefilter.get();
+	view.repeats = repeats.get();
+	view.MASK = static_cast<uint32_t>(bucket_count(view.outer_size, view.layout) - 1);
+
+	return view;
+	}
+
+/*
+	INDEX_WARMER::WARM()
+	--------------------
+	One thread of the pool: take chunks until there are none left.
+*/
+void index_warmer::warm(void)
+	{
+	const uint64_t page_size = sysconf(_SC_PAGESIZE);
+	uint64_t checksum = 0;
+
+	for (size_t which = next++; which < chunks.size(); which = next++)
+		{
+		const chunk &piece = chunks[which];
+
+		/*
+			madvise() wants a page aligned start (the chunks are, unless chunk_size is not a multiple of the page size)
+		*/
+		uintptr_t from = reinterpret_cast<uintptr_t>(piece.start) & ~(page_size - 1);
+		madvise(reinterpret_cast<void *>(from), reinterpret_cast<uintptr_t>(piece.start) + piece.length - from, MADV_WILLNEED);
+
+		for (uint64_t offset = 0; offset < piece.length; offset += page_size)
+			checksum += static_cast<const volatile char *>(piece.start)[offset];
+
+		done += piece.length;
+		}
+
+	asm volatile("" :: "r"(checksum));		// the reads are volatile, but keep the sum from being thrown away too
+	}
+
+/*
+	INDEX_WARMER::START()
+	---------------------
+*/
+void index_warmer::start(const mapped_index &index, size_t thread_count, uint64_t chunk_size)
+	{
+	wait();
+
+	/*
+		Everything is about to be read, so reading ahead of each fault is no longer a waste (and under MADV_RANDOM the
+		kernel reads little of what MADV_WILLNEED asks for)
+	*/
+	chunks.clear();
+	for (const mapped_file *file : {&index.outer, &index.inner, &index.genome})
+		{
+		file->advise(MADV_NORMAL);
+		for (uint64_t offset = 0; offset < file->size(); offset += chunk_size)
+			chunks.push_back(chunk{file->data() + offset, std::min(chunk_size, file->size() - offset)});
+		}
+
+	next = 0;
+	done = 0;
+	total = index.size();
+
+	if (thread_count == 0)
+		thread_count = std::max(1U, std::thread::hardware_concurrency());
+	thread_count = std::min(thread_count, std::max<size_t>(1, chunks.size()));
+	for (size_t thread = 0; thread < thread_count; thread++)
+		threads.push_back(std::thread(&index_warmer::warm, this));
+	}
+
+/*
+	INDEX_WARMER::WAIT()
+	--------------------
+*/
+void index_warmer::wait(bool report)
+	{
+	if (report && total != 0)
+		{
+		uint64_t reported = 0;
+		while (done < total)
+			{
+			uint64_t percent = done * 100 / total;
+			if (percent >= reported + 10)
+				{
+				reported = percent / 10 * 10;
+				std::cout << "Warming index: " << reported << "% (" << done / (1024 * 1024) << " of " << total / (1024 * 1024) << " MB)" << std::endl;
+				}
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			}
+		std::cout << "Warming index: 100% (" << total / (1024 * 1024) << " MB)" << std::endl;
+		}
+
+	for (auto &thread : threads)
+		thread.join();
+	threads.clear();
+	}
@@ -19,6 +19,8 @@
 /*
 	PACKGENOME()
 	------------
+	Remove the ID lines (recording where each record starts in referenceIDMap) and the white space.  Everything else,
+	including N and the other ambiguity codes, is kept so that the indexer can tell which windows are not real k-mers.
 */
 size_t packGenome(char *genome, uint64_t genome_size, std::map<std::uint32_t, std::string> &referenceIDMap)
 	{
@@ -30,7 +32,7 @@ size_t packGenome(char *genome, uint64_t genome_size, std::map<std::uint32_t, st
 	for (from = to = genome; from < end; from++)
 		{
 		char c = *from;
-		if (c == '\n' || c == 'N')
+		if (c == '\n' || c == '\r' || c == ' ' || c == '\t')
 			{/* Nothing */}
 		else if (c == '>')
 			{
@@ -0,0 +1,290 @@
+/*
+	REFERENCECOLLECTION.CPP
+	-----------------------
+	indexReference
+
+	Load a reference collection of many FASTA files (given as a list, a directory, or a manifest) into one packed genome blob.
+	The files are stat()ed, then read and packed, by a pool of readers.  Each file is read straight into its own slot of a
+	single blob (so there is one allocation however many files there are) and packed in place, then the packed files are
+	closed up so that the genome is contiguous.
+*/
+#include <fcntl.h>
+#include <dirent.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include "hugePages.hpp"
+#include "packGenomeBlob.hpp"
+#include "referenceCollection.hpp"
+
+/*
+	CLASS REFERENCE_FILE
+	--------------------
+	One file of the collection: where its raw bytes are read to in the blob and what is left after packing them.
+*/
+class reference_file
+	{
+	public:
+		uint64_t raw_offset;
+		uint64_t raw_size;
+		uint64_t packed_size;
+		std::map<uint32_t, std::string> records;		// offsets are from the start of this file's bases
+		bool failed;
+
+	public:
+		reference_file() :
+			raw_offset(0),
+			raw_size(0),
+			packed_size(0),
+			failed(false)
+			{
+			/* Nothing */
+			}
+	};
+
+/*
+	IS_FASTA_FILENAME()
+	-------------------
+*/
+static bool is_fasta_filename(const std::string &name)
+	{
+	static const char *extensions[] = {".fa", ".fas", ".fasta", ".fna", ".ffn", ".frn"};
+
+	for (const char *extension : extensions)
+		{
+		size_t length = strlen(extension);
+		if (name.size() > length && name.compare(name.size() - length, length, extension) == 0)
+			return true;
+		}
+
+	return false;
+	}
+
+/*
+	LIST_DIRECTORY()
+	----------------
+	The FASTA files in directory and its subdirectories, in name order.
+*/
+static bool list_directory(const std::string &directory, std::vector<std::string> &files)
+	{
+	DIR *handle = opendir(directory.c_str());
+	if (handle == nullptr)
+		{
+		std::cerr << "Error opening the directory: " << directory << std::endl;
+		return false;
+		}
+
+	std::vector<std::string> names;
+	while (struct dirent *entry = readdir(handle))
+		if (entry->d_name[0] != '.')
+			names.push_back(entry->d_name);
+	closedir(handle);
+	std::sort(names.begin(), names.end());
+
+	for (const auto &name : names)
+		{
+		std::string path = directory + (directory.back() == '/' ? "" : "/") + name;
+		struct stat details;
+		if (stat(path.c_str(), &details) != 0)
+			continue;
+		if (S_ISDIR(details.st_mode))
+			{
+			if (!list_directory(path, files))
+				return false;
+			}
+		else if (S_ISREG(details.st_mode) && is_fasta_filename(name))
+			files.push_back(path);
+		}
+
+	return true;
+	}
+
+/*
+	LIST_REFERENCE_FILES()
+	----------------------
+*/
+bool list_reference_files(const std::string &path, std::vector<std::string> &files)
+	{
+	if (path.size() > 1 && path[0] == '@')
+		{
+		std::string manifest = path.substr(1);
+		std::ifstream list(manifest);
+		if (!list)
+			{
+			std::cerr << "Error opening the file: " << manifest << std::endl;
+			return false;
+			}
+
+		size_t slash = manifest.rfind('/');
+		std::string directory = slash == std::string::npos ? "" : manifest.substr(0, slash + 1);
+		std::string line;
+		while (std::getline(list, line))
+			{
+			line.erase(line.find_last_not_of(" \t\r") + 1);
+			if (line.empty() || line[0] == '#')
+				continue;
+			if (!list_reference_files(line[0] == '/' ? line : directory + line, files))
+				return false;
+			}
+
+		return true;
+		}
+
+	struct stat details;
+	if (stat(path.c_str(), &details) != 0)
+		{
+		std::cerr << "Error opening the file: " << path << std::endl;
+		return false;
+		}
+
+	if (S_ISDIR(details.st_mode))
+		return list_directory(path, files);
+
+	files.push_back(path);
+	return true;
+	}
+
+/*
+	FOR_EACH_FILE()
+	---------------
+	Call function(which) for each of count files from a pool of readers, each taking the next file when it finishes the last.
+*/
+template <typename FUNCTION>
+static void for_each_file(size_t count, size_t readers, FUNCTION function)
+	{
+	std::atomic<size_t> next(0);
+	auto reader = [&]()
+		{
+		for (size_t which = next++; which < count; which = next++)
+			function(which);
+		};
+
+	std::vector<std::thread> pool;
+	for (size_t thread = 1; thread < readers; thread++)
+		pool.push_back(std::thread(reader));
+	reader();
+	for (auto &thread : pool)
+		thread.join();
+	}
+
+/*
+	READ_INTO()
+	-----------
+*/
+static bool read_into(const std::string &filename, char *into, uint64_t size)
+	{
+	int handle = open(filename.c_str(), O_RDONLY);
+	if (handle < 0)
+		return false;
+
+	uint64_t got = 0;
+	ssize_t bytes;
+	while (got < size && (bytes = read(handle, into + got, size - got)) > 0)
+		got += bytes;
+	close(handle);
+
+	return got == size;
+	}
+
+/*
+	LOAD_GENOME_FILES()
+	-------------------
+*/
+char *load_genome_files(const std::vector<std::string> &files, std::map<uint32_t, std::string> &referenceIDMap, std::map<uint32_t, std::string> &fileIDMap, uint64_t &genomeSize, size_t readers)
+	{
+	if (readers == 0)
+		readers = std::thread::hardware_concurrency();
+	readers = std::max<size_t>(1, std::min(readers, files.size()));
+
+	if (files.size() == 1)
+		std::cout << std::endl << "Loading References: " << files[0] << std::endl;
+	else
+		std::cout << std::endl << "Loading References: " << files.size() << " files with " << readers << " readers" << std::endl;
+
+	/*
+		Size each file.  Each is followed in the blob by a '\n' so that a file without a final newline cannot run into the next.
+	*/
+	std::vector<reference_file> layout(files.size());
+	for_each_file(files.size(), readers, [&](size_t which)
+		{
+		struct stat details;
+		layout[which].failed = stat(files[which].c_str(), &details) != 0;
+		layout[which].raw_size = layout[which].failed ? 0 : details.st_size;
+		});
+
+	uint64_t rawSize = 0;
+	for (auto &file : layout)
+		{
+		file.raw_offset = rawSize;
+		rawSize += file.raw_size + 1;
+		}
+
+	char *genome = static_cast<char *>(huge_pages::allocate(rawSize + 1));
+	if (genome == nullptr)
+		{
+		std::cerr << "Failed to allocate " << rawSize << " bytes for the reference" << std::endl;
+		exit(1);
+		}
+
+	/*
+		Read and pack each file in its own slot
+	*/
+	for_each_file(files.size(), readers, [&](size_t which)
+		{
+		reference_file &file = layout[which];
+		char *slot = genome + file.raw_offset;
+
+		if (file.failed || !read_into(files[which], slot, file.raw_size))
+			file.failed = true;
+		else
+			{
+			slot[file.raw_size] = '\n';
+			file.packed_size = packGenome(slot, file.raw_size + 1, file.records);
+			}
+		});
+
+	/*
+		Close up the gaps, in file order so that each file only moves towards the start of the blob
+	*/
+	uint64_t packedSize = 0;
+	for (size_t which = 0; which < files.size(); which++)
+		{
+		const reference_file &file = layout[which];
+		if (file.failed)
+			{
+			std::cerr << "Failed to read " << files[which] << std::endl;
+			exit(1);
+			}
+		if (file.packed_size == 0)
+			continue;
+		if (packedSize + file.packed_size > UINT32_MAX)
+			{
+			std::cerr << "The reference is larger than 4GB (at " << files[which] << ")" << std::endl;
+			exit(1);
+			}
+
+		fileIDMap[packedSize] = files[which] + "\n";
+		if (file.records.empty() || file.records.begin()->first != 0)
+			referenceIDMap[packedSize] = ">" + files[which] + "\n";
+		for (const auto &record : file.records)
+			referenceIDMap[packedSize + record.first] = record.second;
+
+		if (packedSize != file.raw_offset)
+			memmove(genome + packedSize, genome + file.raw_offset, file.packed_size);
+		packedSize += file.packed_size;
+		}
+	genome[packedSize] = '\0';
+
+	std::cout << "Reference file size on disk " << rawSize - files.size() << std::endl;
+	std::cout << "        Reference blob size " << packedSize << std::endl;
+
+	genomeSize = packedSize;
+	return genome;
+	}
@@ -0,0 +1,218 @@
+/*
+	REPEATBUCKETS.CPP
+	-----------------
+	indexReference
+
+	Bucket size statistics, and a side table for the high-frequency (repeat) buckets that are taken out of the index.
+*/
+#include <fstream>
+#include <algorithm>
+
+#include "repeatBuckets.hpp"
+
+/*
+	BUCKET_STATISTICS::PERCENTILE()
+	-------------------------------
+	The posting list length at the given percentile of the non-empty buckets.
+*/
+uint64_t bucket_statistics::percentile(double percent) const
+	{
+	uint64_t wanted = static_cast<uint64_t>(occupied * percent / 100.0);
+	uint64_t seen = 0;
+
+	for (const auto &length : histogram)
+		{
+		seen += length.second;
+		if (seen > wanted)
+			return length.first;
+		}
+
+	return largest;
+	}
+
+/*
+	BUCKET_STATISTICS::BUCKETS_OVER()
+	---------------------------------
+	The number of buckets longer than threshold (and, optionally, the number of positions in them).
+*/
+uint64_t bucket_statistics::buckets_over(uint64_t threshold, uint64_t *positions) const
+	{
+	uint64_t count = 0;
+	uint64_t total = 0;
+
+	for (auto length = histogram.upper_bound(threshold); length != histogram.end(); length++)
+		{
+		count += length->second;
+		total += length->first * length->second;
+		}
+
+	if (positions != nullptr)
+		*positions = total;
+
+	return count;
+	}
+
+/*
+	BUCKET_STATISTICS::REPORT()
+	---------------------------
+*/
+void bucket_statistics::report(std::ostream &out, uint64_t threshold) const
+	{
+	out << "Buckets " << buckets << ", occupied " << occupied << ", positions " << postings << std::endl;
+	out << "Bucket length p50 " << percentile(50) << ", p99 " << percentile(99) << ", p99.9 " << percentile(99.9) << ", max " << largest << std::endl;
+
+	/*
+		Power of two histogram
+	*/
+	out << "Bucket length histogram (length: buckets positions)" << std::endl;
+	uint64_t bin_buckets = 0;
+	uint64_t bin_positions = 0;
+	uint64_t bin_top = 1;
+	for (auto length = histogram.begin(); length != histogram.end(); length++)
+		{
+		while (length->first > bin_top)
+			{
+			if (bin_buckets != 0)
+				out << "  <=" << bin_top << ": " << bin_buckets << " " << bin_positions << std::endl;
+			bin_buckets = bin_positions = 0;
+			bin_top *= 2;
+			}
+		bin_buckets += length->second;
+		bin_positions += length->first * length->second;
+		}
+	if (bin_buckets != 0)
+		out << "  <=" << bin_top << ": " << bin_buckets << " " << bin_positions << std::endl;
+
+	if (threshold != 0)
+		{
+		uint64_t positions;
+		uint64_t count = buckets_over(threshold, &positions);
+		out << "Buckets longer than " << threshold << ": " << count << " holding " << positions << " positions (" << (postings == 0 ? 0 : positions * 100.0 / postings) << "%)" << std::endl;
+		}
+	}
+
+/*
+	REPEATTABLEFILENAME()
+	---------------------
+*/
+std::string repeatTableFilename(const std::string &baseName)
+	{
+	return baseName + "_32_Repeats.idx";
+	}
+
+/*
+	REPEAT_TABLE::SERIALIZE()
+	-------------------------
+*/
+bool repeat_table::serialize(const std::string &filename) const
+	{
+	std::ofstream outputFile(filename, std::ios::binary);
+	if (!outputFile.is_open())
+		return false;
+
+	uint32_t count = static_cast<uint32_t>(entries.size());
+	outputFile.write(reinterpret_cast<const char *>(&count), sizeof(count));
+	outputFile.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(repeat_bucket));
+	outputFile.write(reinterpret_cast<const char *>(positions.data()), positions.size() * sizeof(uint32_t));
+
+	return outputFile.good();
+	}
+
+/*
+	REPEAT_TABLE::DESERIALIZE()
+	---------------------------
+*/
+bool repeat_table::deserialize(const std::string &filename)
+	{
+	std::ifstream inputFile(filename, std::ios::binary);
+	uint32_t count;
+
+	entries.clear();
+	positions.clear();
+	if (!inputFile.read(reinterpret_cast<char *>(&count), sizeof(count)))
+		return false;
+
+	entries.resize(count);
+	if (!inputFile.read(reinterpret_cast<char *>(entries.data()), count * sizeof(repeat_bucket)))
+		return false;
+
+	uint64_t stored = 0;
+	for (const auto &entry : entries)
+		stored += entry.stored;
+	positions.resize(stored);
+
+	return static_cast<bool>(inputFile.read(reinterpret_cast<char *>(positions.data()), stored * sizeof(uint32_t)));
+	}
+
+/*
+	REPEAT_TABLE::FIND()
+	--------------------
+*/
+const repeat_bucket *repeat_table::find(uint32_t bucket) const
+	{
+	auto found = std::lower_bound(entries.begin(), entries.end(), bucket, [](const repeat_bucket &entry, uint32_t value) { return entry.bucket < value; });
+
+	return found != entries.end() && found->bucket == bucket ? &*found : nullptr;
+	}
+
+/*
+	REPEAT_TABLE::EXTRACT()
+	-----------------------
+*/
+void repeat_table::extract(huge_page_vector<protected_vector<uint32_t>> &kmersMap, uint32_t threshold, bool keepPositions)
+	{
+	entries.clear();
+	positions.clear();
+
+	for (size_t bucket = 0; bucket < kmersMap.size(); bucket++)
+		{
+		auto &innerVector = kmersMap[bucket];
+		if (innerVector.size() <= threshold)
+			continue;
+
+		repeat_bucket entry;
+		entry.bucket = static_cast<uint32_t>(bucket);
+		entry.count = static_cast<uint32_t>(innerVector.size());
+		entry.offset = static_cast<uint32_t>(positions.size());
+		entry.stored = 0;
+		if (keepPositions)
+			{
+			std::sort(innerVector.begin(), innerVector.end());
+			positions.insert(positions.end(), innerVector.begin(), innerVector.end());
+			entry.stored = entry.count;
+			}
+		entries.push_back(entry);
+
+		std::vector<uint32_t>().swap(innerVector);
+		}
+	}
+
+/*
+	REPEAT_TABLE::ABSORB()
+	----------------------
+	New positions are larger than the existing ones so they go on the end of each entry's stored positions.
+*/
+void repeat_table::absorb(huge_page_vector<protected_vector<uint32_t>> &kmersMap)
+	{
+	std::vector<uint32_t> merged;
+
+	for (auto &entry : entries)
+		{
+		auto &innerVector = kmersMap[entry.bucket];
+		std::sort(innerVector.begin(), innerVector.end());
+
+		uint32_t offset = static_cast<uint32_t>(merged.size());
+		merged.insert(merged.end(), positions.begin() + entry.offset, positions.begin() + entry.offset + entry.stored);
+		if (entry.stored != 0)
+			{
+			merged.insert(merged.end(), innerVector.begin(), innerVector.end());
+			entry.stored += static_cast<uint32_t>(innerVector.size());
+			}
+		entry.offset = offset;
+		entry.count += static_cast<uint32_t>(innerVector.size());
+
+		std::vector<uint32_t>().swap(innerVector);
+		}
+
+	positions.swap(merged);
+	}
@@ -0,0 +1,278 @@
+/*
+	SEEDEXTENSION.CPP
+	-----------------
+	indexReference
+
+	Verify a seed at a genome position, on either strand, and extend it to the longest exact match.
+*/
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+#include "seedExtension.hpp"
+#include "encode_kmer_2bit.h"
+
+/*
+	EVEN_BITS
+	---------
+	The low bit of each 2-bit base
+*/
+static const uint64_t EVEN_BITS = 0x5555555555555555ULL;
+
+/*
+	PACK_BASES()
+	------------
+	Pack count (at most 32) bases into the 2-bit layout, and mark those that are not A, C, G or T.
+*/
+static inline void pack_bases(const char *sequence, size_t count, uint64_t &bases, uint64_t &ambiguous)
+	{
+	bases = 0;
+	ambiguous = 0;
+	for (size_t base = 0; base < count; base++)
+		{
+		uint64_t valid = encode_kmer_2bit::is_base(sequence[base]);
+		bases |= encode_kmer_2bit::pack_1mer(valid ? sequence[base] : 'A') << (2 * base);
+		ambiguous |= (valid ^ 1) << (2 * base);
+		}
+	}
+
+/*
+	PACK_SEQUENCE()
+	---------------
+	Pack size bases into words with PADDING ambiguous bases before and after them.
+*/
+template <typename VECTOR>
+static void pack_sequence(const char *sequence, uint64_t size, VECTOR &bases, VECTOR &ambiguous)
+	{
+	const uint64_t padding_words = seed_query::PADDING / 32;
+	uint64_t words = padding_words + (size + 31) / 32 + padding_words + 1;
+
+	bases.assign(words, 0);
+	ambiguous.assign(words, EVEN_BITS);
+	for (uint64_t start = 0; start < size; start += 32)
+		{
+		uint64_t count = std::min<uint64_t>(32, size - start);
+		uint64_t packed;
+		uint64_t unknown;
+		pack_bases(sequence + start, count, packed, unknown);
+		bases[padding_words + start / 32] = packed;
+		ambiguous[padding_words + start / 32] = count == 32 ? unknown : unknown | (EVEN_BITS << (2 * count));
+		}
+	}
+
+/*
+	SEED_QUERY::ASSIGN()
+	--------------------
+*/
+void seed_query::assign(const char *sequence, uint32_t length)
+	{
+	static const char complement[4] = {'T', 'G', 'C', 'A'};
+	this->length = length;
+
+	std::vector<char> reverse(length);
+	for (uint32_t base = 0; base < length; base++)
+		{
+		char from = sequence[length - 1 - base];
+		reverse[base] = encode_kmer_2bit::is_base(from) ? complement[encode_kmer_2bit::pack_1mer(from)] : 'N';
+		}
+
+	for (int strand = 0; strand < 2; strand++)
+		{
+		const char *from = strand == 0 ? sequence : reverse.data();
+		ascii[strand].assign(PADDING + length + PADDING, '\0');
+		for (uint32_t base = 0; base < length; base++)
+			ascii[strand][PADDING + base] = encode_kmer_2bit::is_base(from[base]) ? from[base] | 0x20 : '\0';
+		pack_sequence(from, length, bases[strand], ambiguous[strand]);
+		}
+	}
+
+/*
+	PACKED_GENOME::ASSIGN()
+	-----------------------
+*/
+void packed_genome::assign(const char *genome, uint64_t size)
+	{
+	this->size = size;
+	pack_sequence(genome, size, bases, ambiguous);
+	}
+
+/*
+	CLASS ASCII_KERNEL
+	------------------
+	Compare the one byte per base genome with the query.  The genome is lower-cased by or-ing in 0x20, which cannot make
+	anything but a base equal a query base (the query holds acgt or '\0').
+*/
+class ascii_kernel
+	{
+	public:
+		const char *genome;
+
+	public:
+		/*
+			ASCII_KERNEL::FORWARD()
+			-----------------------
+			The number of bases (up to limit) that match from genome[position] and query[from] onwards.
+		*/
+		inline uint64_t forward(const seed_query &query, int strand, uint64_t from, uint64_t position, uint64_t limit) const
+			{
+			const char *sequence = query.ascii[strand].data() + seed_query::PADDING + from;
+			const char *reference = genome + position;
+			uint64_t length = 0;
+
+#if defined(__SSE2__)
+			const __m128i lower = _mm_set1_epi8(0x20);
+			for (; length + 16 <= limit; length += 16)
+				{
+				__m128i bases = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(reference + length)), lower);
+				__m128i wanted = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sequence + length));
+				uint32_t differ = ~_mm_movemask_epi8(_mm_cmpeq_epi8(bases, wanted)) & 0xffff;
+				if (differ != 0)
+					return length + __builtin_ctz(differ);
+				}
+#endif
+			for (; length < limit; length++)
+				if ((reference[length] | 0x20) != sequence[length])
+					break;
+
+			return length;
+			}
+
+		/*
+			ASCII_KERNEL::BACKWARD()
+			------------------------
+			The number of bases (up to limit) that match going back from genome[position - 1] and query[from - 1].
+		*/
+		inline uint64_t backward(const seed_query &query, int strand, uint64_t from, uint64_t position, uint64_t limit) const
+			{
+			const char *sequence = query.ascii[strand].data() + seed_query::PADDING + from;
+			const char *reference = genome + position;
+			uint64_t length = 0;
+
+#if defined(__SSE2__)
+			const __m128i lower = _mm_set1_epi8(0x20);
+			for (; length + 16 <= limit; length += 16)
+				{
+				__m128i bases = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(reference - length - 16)), lower);
+				__m128i wanted = _mm_loadu_si128(reinterpret_cast<const __m128i *>(sequence - length - 16));
+				uint32_t differ = ~_mm_movemask_epi8(_mm_cmpeq_epi8(bases, wanted)) & 0xffff;
+				if (differ != 0)
+					return length + __builtin_clz(differ) - 16;
+				}
+#endif
+			for (; length < limit; length++)
+				if ((reference[-1 - static_cast<int64_t>(length)] | 0x20) != sequence[-1 - static_cast<int64_t>(length)])
+					break;
+
+			return length;
+			}
+	};
+
+/*
+	CLASS PACKED_KERNEL
+	-------------------
+	Compare the 2-bit packed genome with the query, 32 bases at a time.  Both are padded with ambiguous bases so the reads
+	need no bounds checks, and an ambiguous base on either side counts as a difference.
+*/
+class packed_kernel
+	{
+	public:
+		const packed_genome *genome;
+
+	public:
+		/*
+			PACKED_KERNEL::BASES_AT()
+			-------------------------
+			The 32 bases from base (counted from the start of the padding) onwards.
+		*/
+		static inline uint64_t bases_at(const uint64_t *words, uint64_t base)
+			{
+			uint64_t word = base / 32;
+			uint64_t shift = 2 * (base % 32);
+			return shift == 0 ? words[word] : (words[word] >> shift) | (words[word + 1] << (64 - shift));
+			}
+
+		/*
+			PACKED_KERNEL::DIFFERENCES()
+			----------------------------
+			01 at each of the 32 bases from the given genome and query bases onwards that differ or are ambiguous.
+		*/
+		inline uint64_t differences(const seed_query &query, int strand, uint64_t from, uint64_t position) const
+			{
+			uint64_t differ = bases_at(genome->bases.data(), position) ^ bases_at(query.bases[strand].data(), from);
+			return ((differ | (differ >> 1)) & EVEN_BITS) | bases_at(genome->ambiguous.data(), position) | bases_at(query.ambiguous[strand].data(), from);
+			}
+
+		inline uint64_t forward(const seed_query &query, int strand, uint64_t from, uint64_t position, uint64_t limit) const
+			{
+			for (uint64_t length = 0; length < limit; length += 32)
+				if (uint64_t differ = differences(query, strand, seed_query::PADDING + from + length, seed_query::PADDING + position + length))
+					return std::min(limit, length + __builtin_ctzll(differ) / 2);
+
+			return limit;
+			}
+
+		inline uint64_t backward(const seed_query &query, int strand, uint64_t from, uint64_t position, uint64_t limit) const
+			{
+			for (uint64_t length = 0; length < limit; length += 32)
+				if (uint64_t differ = differences(query, strand, seed_query::PADDING + from - length - 32, seed_query::PADDING + position - length - 32))
+					return std::min(limit, length + __builtin_clzll(differ) / 2);
+
+			return limit;
+			}
+	};
+
+/*
+	EXTEND()
+	--------
+	The seed is at query offset seed on the forward strand, and so at length - 32 - seed on the reverse complement.  On
+	each strand in turn, match forward from the seed (which verifies it if at least 32 bases match) then extend backward.
+*/
+template <typename KERNEL>
+static seed_match extend(const KERNEL &kernel, uint64_t first, uint64_t last, const seed_query &query, uint32_t seed, uint32_t position)
+	{
+	seed_match match = {0, position, 0, false};
+
+	if (seed + 32ULL > query.length || position < first || position + 32ULL > last)
+		return match;
+
+	for (int strand = 0; strand < 2; strand++)
+		{
+		uint64_t from = strand == 0 ? seed : query.length - 32 - seed;
+		uint64_t right = kernel.forward(query, strand, from, position, std::min<uint64_t>(query.length - from, last - position));
+		if (right < 32)
+			continue;
+		uint64_t left = kernel.backward(query, strand, from, position, std::min<uint64_t>(from, position - first));
+
+		match.length = static_cast<uint32_t>(left + right);
+		match.position = static_cast<uint32_t>(position - left);
+		match.query_start = static_cast<uint32_t>(strand == 0 ? from - left : query.length - (from - left) - match.length);
+		match.reverse = strand == 1;
+		break;
+		}
+
+	return match;
+	}
+
+/*
+	EXTEND_SEED()
+	-------------
+*/
+seed_match extend_seed(const char *genome, uint64_t first, uint64_t last, const seed_query &query, uint32_t seed, uint32_t position)
+	{
+	ascii_kernel kernel = {genome};
+	return extend(kernel, first, last, query, seed, position);
+	}
+
+/*
+	EXTEND_SEED()
+	-------------
+*/
+seed_match extend_seed(const packed_genome &genome, uint64_t first, uint64_t last, const seed_query &query, uint32_t seed, uint32_t position)
+	{
+	packed_kernel kernel = {&genome};
+	return extend(kernel, first, std::min(last, genome.size), query, seed, position);
+	}
@@ -13,44 +13,142 @@
 
 #include "serialiseKmersMap.hpp"
 
+/*
+	CLASS BUCKET_WRITER
+	-------------------
+	Write the Inner and Outer blobs a bucket at a time in either layout.  A bucket's positions are given in two sorted parts
+	(the second all larger than the first) so that appending to an index needs no merge buffer.
+*/
+class bucket_writer
+	{
+	private:
+		static constexpr std::streamsize bufferSize = 1024 * 1024;
+
+		bucket_layout layout;
+		std::ofstream innerMapFile;
+		std::ofstream outerMapFile;
+		uint32_t offset;
+
+	public:
+		bucket_writer(const std::string &innerMapFilename, const std::string &outerMapFilename, bucket_layout layout) :
+			layout(layout),
+			offset(0)
+			{
+			innerMapFile.rdbuf()->pubsetbuf(nullptr, bufferSize);
+			innerMapFile.open(innerMapFilename, std::ios::binary);
+			outerMapFile.rdbuf()->pubsetbuf(nullptr, bufferSize);
+			outerMapFile.open(outerMapFilename, std::ios::binary);
+			}
+
+		void add(const uint32_t *first, size_t firstCount, const uint32_t *second = nullptr, size_t secondCount = 0)
+			{
+			size_t count = firstCount + secondCount;
+
+			if (layout == OFFSET_LAYOUT)
+				{
+				/*
+					The offset of the positions, then the positions followed by a sentinal of UINT32_MAX
+				*/
+				uint32_t largest = UINT32_MAX;
+				outerMapFile.write(reinterpret_cast<const char *>(&offset), sizeof(uint32_t));
+				innerMapFile.write(reinterpret_cast<const char *>(first), firstCount * sizeof(uint32_t));
+				innerMapFile.write(reinterpret_cast<const char *>(second), secondCount * sizeof(uint32_t));
+				if (count != 0)
+					innerMapFile.write(reinterpret_cast<const char *>(&largest), sizeof(largest));
+				offset += static_cast<uint32_t>(count) + (count == 0 ? 0 : 1);
+				return;
+				}
+
+			/*
+				The positions in the entry if there are one or two of them, otherwise spill them to the InnerBlob
+			*/
+			auto position = [&](size_t which) { return which < firstCount ? first[which] : second[which - firstCount]; };
+			uint64_t entry;
+			if (count == 0)
+				entry = inline_bucket::empty();
+			else if (count == 1)
+				entry = inline_bucket::single(position(0));
+			else if (count == 2 && position(1) <= inline_bucket::LARGEST_DOUBLE)
+				entry = inline_bucket::pair(position(0), position(1));
+			else
+				{
+				if (count > inline_bucket::LARGEST_SPILL)
+					{
+					std::cerr << "A bucket of " << count << " positions is too large for the inline layout, use -repeats to remove it" << std::endl;
+					exit(1);
+					}
+				entry = inline_bucket::spill(offset, static_cast<uint32_t>(count));
+				innerMapFile.write(reinterpret_cast<const char *>(first), firstCount * sizeof(uint32_t));
+				innerMapFile.write(reinterpret_cast<const char *>(second), secondCount * sizeof(uint32_t));
+				offset += static_cast<uint32_t>(count);
+				}
+			outerMapFile.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+			}
+	};
+
 /*
 	SERIALIZEMAP()
 	--------------
 */
-void serializeMap(std::vector<protected_vector<uint32_t>> &kmersMap, const std::string &innerMapFilename, const std::string &outerMapFilename)
+void serializeMap(huge_page_vector<protected_vector<uint32_t>> &kmersMap, const std::string &innerMapFilename, const std::string &outerMapFilename, bucket_layout layout)
 	{
-	// Set the buffer size to 8192 bytes (for example)
-	constexpr std::streamsize bufferSize = 1024 * 1024;
-    uint32_t largest = UINT32_MAX;
-
-	// Open the files with custom buffer sizes
-	std::ofstream innerMapFile(innerMapFilename, std::ios::binary);
-	innerMapFile.rdbuf()->pubsetbuf(nullptr, bufferSize);
+	serializeMapRange(kmersMap, 0, kmersMap.size(), innerMapFilename, outerMapFilename, layout);
+	}
 
-	std::ofstream outerMapFile(outerMapFilename, std::ios::binary);
-	outerMapFile.rdbuf()->pubsetbuf(nullptr, bufferSize);
+/*
+	SERIALIZEMAPRANGE()
+	-------------------
+	Serialise buckets [first, last) of kmersMap.  The OuterBlob has one entry per bucket in the range and the offsets start
+	from 0, so a shard's blobs look exactly like those of a whole index over a smaller hash range.
+*/
+void serializeMapRange(huge_page_vector<protected_vector<uint32_t>> &kmersMap, size_t first, size_t last, const std::string &innerMapFilename, const std::string &outerMapFilename, bucket_layout layout)
+	{
+	bucket_writer writer(innerMapFilename, outerMapFilename, layout);
 
-	uint32_t offset = 0;
-	for (auto &innerVector : kmersMap)
+	for (size_t index = first; index < last; index++)
 		{
-		// Write inner vector data then put a sentinal of UINT32_MAX on the end
+		auto &innerVector = kmersMap[index];
         std::sort(innerVector.begin(), innerVector.end());
-		innerMapFile.write(reinterpret_cast<const char *>(innerVector.data()), innerVector.size() * sizeof(uint32_t));
-        if (innerVector.size() != 0)
-    		innerMapFile.write(reinterpret_cast<const char *>(&largest), sizeof(largest));
+		writer.add(innerVector.data(), innerVector.size());
+		}
+	}
 
-		// Write the offset for the outer map
-		outerMapFile.write(reinterpret_cast<const char *>(&offset), sizeof(uint32_t));
+/*
+	APPENDTOSERIALIZEDMAP()
+	-----------------------
+	Merge newly indexed positions (kmersMap) into an existing deserialised index and write the result.  Every new position
+	is larger than every existing one so each bucket's merge is the old postings followed by the (sorted) new postings.
+	The buckets in repeats (if given) are written empty, as their positions are in the repeat table.
+*/
+void appendToSerializedMap(const huge_page_vector<uint32_t> &innerMapBlob, const huge_page_vector<uint32_t> &outerMapBlob, huge_page_vector<protected_vector<uint32_t>> &kmersMap, const std::string &innerMapFilename, const std::string &outerMapFilename, bucket_layout layout, const repeat_table *repeats)
+	{
+	bucket_writer writer(innerMapFilename, outerMapFilename, layout);
+	const repeat_bucket *repeat = repeats == nullptr ? nullptr : repeats->entries.data();
+	const repeat_bucket *repeatsEnd = repeats == nullptr ? nullptr : repeat + repeats->entries.size();
 
-		// Calculate the offset for the next inner vector (plus the sentinal)
-		offset += static_cast<uint32_t>(innerVector.size()) + (innerVector.size() == 0 ? 0 : 1);
+	for (size_t index = 0; index < kmersMap.size(); index++)
+		{
+		auto &innerVector = kmersMap[index];
+		std::sort(innerVector.begin(), innerVector.end());
+
+		const uint32_t *oldPositions;
+		uint32_t scratch[2];
+		size_t oldSize = bucket_positions(innerMapBlob.data(), innerMapBlob.size(), outerMapBlob.data(), outerMapBlob.size(), index, layout, oldPositions, scratch);
+		if (repeat != repeatsEnd && repeat->bucket == index)
+			{
+			oldSize = 0;
+			repeat++;
+			}
+		writer.add(oldPositions, oldSize, innerVector.data(), innerVector.size());
 		}
-
-	innerMapFile.close();
-	outerMapFile.close();
 	}
 
-void deserializeMap(const std::string& innerMapFilename, const std::string& outerMapFilename, std::vector<uint32_t>& innerMapBlob, std::vector<uint32_t>& outerMapBlob) {
+/*
+	DESERIALIZEMAP()
+	----------------
+	The blobs are read as uint32_t words whatever the layout.  Returns false if the OuterBlob cannot be in the given layout.
+*/
+bool deserializeMap(const std::string& innerMapFilename, const std::string& outerMapFilename, huge_page_vector<uint32_t>& innerMapBlob, huge_page_vector<uint32_t>& outerMapBlob, bucket_layout layout) {
     std::ifstream innerMapFile(innerMapFilename, std::ios::binary);
     std::ifstream outerMapFile(outerMapFilename, std::ios::binary);
 
@@ -72,16 +170,26 @@ void deserializeMap(const std::string& innerMapFilename, const std::string& oute
 
     innerMapFile.close();
     outerMapFile.close();
+
+    if (layout == INLINE_LAYOUT && outerMapBlob.size() % 2 != 0) {
+        std::cerr << outerMapFilename << " is not an OuterBlob in the " << bucket_layout_name(layout) << " layout" << std::endl;
+        return false;
+    }
+
+    return true;
 }
 
-// Helper function to access the index
-std::vector<uint32_t> getInnerVector(const std::vector<uint32_t>& innerMapBlob, const std::vector<uint32_t>& outerMapBlob, size_t index) {
+// Helper function to access the index, the positions in the bucket are followed by a UINT32_MAX sentinal (whatever the layout)
+std::vector<uint32_t> getInnerVector(const huge_page_vector<uint32_t>& innerMapBlob, const huge_page_vector<uint32_t>& outerMapBlob, size_t index, bucket_layout layout) {
     std::vector<uint32_t> innerVector;
 
-    if (index < outerMapBlob.size()) {
-        size_t startOffset = outerMapBlob[index];
-        size_t endOffset = (index + 1 < outerMapBlob.size()) ? outerMapBlob[index + 1] : innerMapBlob.size();
-        innerVector = std::vector<uint32_t>(innerMapBlob.begin() + startOffset, innerMapBlob.begin() + endOffset);
+    if (index < bucket_count(outerMapBlob.size(), layout)) {
+        const uint32_t *positions;
+        uint32_t scratch[2];
+        size_t count = bucket_positions(innerMapBlob.data(), innerMapBlob.size(), outerMapBlob.data(), outerMapBlob.size(), index, layout, positions, scratch);
+        innerVector.assign(positions, positions + count);
+        if (count != 0)
+            innerVector.push_back(UINT32_MAX);
     }
 
     return innerVector;
@@ -0,0 +1,391 @@
+/*
+	SHARDINDEX.CPP
+	--------------
+	indexReference
+
+	Split the index into shards, each covering a contiguous range of the kmerHash space, and route queries to them.
+*/
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <thread>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include "hash.hpp"
+#include "shardIndex.hpp"
+#include "indexMetadata.hpp"
+#include "serialiseKmersMap.hpp"
+
+/*
+	SHARDFILENAME()
+	---------------
+*/
+std::string shardFilename(const std::string &baseName, size_t shard, const std::string &blob)
+	{
+	return baseName + "_32_Shard" + std::to_string(shard) + "_" + blob + ".idx";
+	}
+
+/*
+	SHARDMANIFESTFILENAME()
+	-----------------------
+*/
+std::string shardManifestFilename(const std::string &baseName)
+	{
+	return baseName + "_32_Shards.idx";
+	}
+
+/*
+	SERIALIZESHARDS()
+	-----------------
+	Write shardCount shards of roughly equal hash range, and a manifest listing the bucket count and each shard's range.
+*/
+void serializeShards(huge_page_vector<protected_vector<uint32_t>> &kmersMap, const std::string &baseName, size_t shardCount, bucket_layout layout)
+	{
+	uint64_t bucketCount = kmersMap.size();
+	std::ofstream manifest(shardManifestFilename(baseName));
+	manifest << bucketCount << " " << shardCount << "\n";
+
+	for (size_t shard = 0; shard < shardCount; shard++)
+		{
+		uint64_t first = bucketCount * shard / shardCount;
+		uint64_t last = bucketCount * (shard + 1) / shardCount;
+		serializeMapRange(kmersMap, first, last, shardFilename(baseName, shard, "InnerBlob"), shardFilename(baseName, shard, "OuterBlob"), layout);
+		manifest << first << " " << last << "\n";
+		}
+
+	manifest.close();
+	}
+
+/*
+	READSHARDMANIFEST()
+	-------------------
+*/
+bool readShardManifest(const std::string &baseName, uint64_t &bucketCount, std::vector<shard_range> &ranges)
+	{
+	std::ifstream manifest(shardManifestFilename(baseName));
+	size_t shardCount;
+
+	if (!(manifest >> bucketCount >> shardCount))
+		return false;
+
+	ranges.resize(shardCount);
+	for (auto &range : ranges)
+		if (!(manifest >> range.first >> range.last))
+			return false;
+
+	return true;
+	}
+
+/*
+	REMOVESHARDS()
+	--------------
+	Remove the manifest and every shard it lists (if there is a manifest).
+*/
+void removeShards(const std::string &baseName)
+	{
+	uint64_t bucketCount;
+	std::vector<shard_range> ranges;
+	readShardManifest(baseName, bucketCount, ranges);
+	for (size_t shard = 0; shard < ranges.size(); shard++)
+		{
+		remove(shardFilename(baseName, shard, "InnerBlob").c_str());
+		remove(shardFilename(baseName, shard, "OuterBlob").c_str());
+		}
+	remove(shardManifestFilename(baseName).c_str());
+	}
+
+/*
+	LOCAL_SHARD::OPEN()
+	-------------------
+*/
+bool local_shard::open(const std::string &baseName, size_t shard)
+	{
+	return deserializeMap(shardFilename(baseName, shard, "InnerBlob"), shardFilename(baseName, shard, "OuterBlob"), innerMapBlob, outerMapBlob, layout);
+	}
+
+/*
+	LOAD_LOCAL_SHARD()
+	------------------
+	Load a shard into this process, or exit.
+*/
+static local_shard *load_local_shard(const std::string &baseName, size_t shard, const shard_range &range, bucket_layout layout)
+	{
+	local_shard *loaded = new local_shard(range, layout);
+	if (!loaded->open(baseName, shard))
+		exit(1);
+	return loaded;
+	}
+
+/*
+	LOCAL_SHARD::LOOKUP()
+	---------------------
+*/
+bool local_shard::lookup(const std::vector<uint32_t> &buckets, std::vector<std::vector<uint32_t>> &postings)
+	{
+	postings.resize(buckets.size());
+	for (size_t which = 0; which < buckets.size(); which++)
+		{
+		size_t index = buckets[which] - range.first;
+		const uint32_t *positions;
+		uint32_t scratch[2];
+		size_t count = bucket_positions(innerMapBlob.data(), innerMapBlob.size(), outerMapBlob.data(), outerMapBlob.size(), index, layout, positions, scratch);
+
+		postings[which].assign(positions, positions + count);
+		}
+
+	return true;
+	}
+
+/*
+	READ_ALL()
+	----------
+*/
+static bool read_all(int fd, void *buffer, size_t length)
+	{
+	char *into = static_cast<char *>(buffer);
+	while (length > 0)
+		{
+		ssize_t got = read(fd, into, length);
+		if (got <= 0)
+			return false;
+		into += got;
+		length -= got;
+		}
+	return true;
+	}
+
+/*
+	WRITE_ALL()
+	-----------
+*/
+static bool write_all(int fd, const void *buffer, size_t length)
+	{
+	const char *from = static_cast<const char *>(buffer);
+	while (length > 0)
+		{
+		ssize_t sent = write(fd, from, length);
+		if (sent <= 0)
+			return false;
+		from += sent;
+		length -= sent;
+		}
+	return true;
+	}
+
+/*
+	PROCESS_SHARD::PROCESS_SHARD()
+	------------------------------
+	Fork a child that loads the shard and then answers requests until it is told to stop.  A request is a count followed by
+	that many buckets, the reply is, for each bucket, a count followed by that many positions.  A count of UINT32_MAX asks
+	the child to exit (closing the pipe is not enough because later children inherit the write end).
+*/
+process_shard::process_shard(const std::string &baseName, size_t shard, const shard_range &range, bucket_layout layout) :
+	failed(false)
+	{
+	int request[2];
+	int reply[2];
+
+	if (pipe(request) != 0 || pipe(reply) != 0)
+		{
+		std::cerr << "Failed to create the pipes for shard " << shard << std::endl;
+		exit(1);
+		}
+
+	child = fork();
+	if (child < 0)
+		{
+		std::cerr << "Failed to start the process for shard " << shard << std::endl;
+		exit(1);
+		}
+
+	if (child == 0)
+		{
+		close(request[1]);
+		close(reply[0]);
+
+		/*
+			The child leaves with _exit() on every path so that it neither runs the parent's atexit handlers nor flushes its
+			copies of the parent's stdio buffers
+		*/
+		local_shard server(range, layout);
+		if (!server.open(baseName, shard))
+			_exit(1);
+		std::vector<uint32_t> buckets;
+		std::vector<std::vector<uint32_t>> postings;
+		uint32_t count;
+
+		while (read_all(request[0], &count, sizeof(count)) && count != UINT32_MAX)
+			{
+			buckets.resize(count);
+			if (!read_all(request[0], buckets.data(), count * sizeof(uint32_t)))
+				break;
+			server.lookup(buckets, postings);
+			for (const auto &list : postings)
+				{
+				uint32_t length = static_cast<uint32_t>(list.size());
+				if (!write_all(reply[1], &length, sizeof(length)) || !write_all(reply[1], list.data(), length * sizeof(uint32_t)))
+					_exit(1);
+				}
+			}
+		_exit(0);
+		}
+
+	close(request[0]);
+	close(reply[1]);
+	request_fd = request[1];
+	reply_fd = reply[0];
+	}
+
+/*
+	PROCESS_SHARD::~PROCESS_SHARD()
+	-------------------------------
+*/
+process_shard::~process_shard()
+	{
+	uint32_t stop = UINT32_MAX;
+	write_all(request_fd, &stop, sizeof(stop));
+	close(request_fd);
+	close(reply_fd);
+	waitpid(child, nullptr, 0);
+	}
+
+/*
+	PROCESS_SHARD::LOOKUP()
+	-----------------------
+*/
+bool process_shard::lookup(const std::vector<uint32_t> &buckets, std::vector<std::vector<uint32_t>> &postings)
+	{
+	if (failed)
+		return false;
+
+	uint32_t count = static_cast<uint32_t>(buckets.size());
+	if (!write_all(request_fd, &count, sizeof(count)) || !write_all(request_fd, buckets.data(), count * sizeof(uint32_t)))
+		return !(failed = true);
+
+	/*
+		Once a read comes up short the rest of the reply cannot be found, so the shard is done for
+	*/
+	postings.resize(buckets.size());
+	for (auto &list : postings)
+		{
+		uint32_t length;
+		if (!read_all(reply_fd, &length, sizeof(length)))
+			return !(failed = true);
+		list.resize(length);
+		if (!read_all(reply_fd, list.data(), length * sizeof(uint32_t)))
+			return !(failed = true);
+		}
+
+	return true;
+	}
+
+/*
+	SHARD_ROUTER::SHARD_ROUTER()
+	----------------------------
+*/
+shard_router::shard_router(const std::string &baseName, bool separateProcesses) :
+	baseName(baseName)
+	{
+	uint64_t bucketCount;
+	if (!readShardManifest(baseName, bucketCount, ranges))
+		{
+		std::cerr << "Failed to read " << shardManifestFilename(baseName) << std::endl;
+		exit(1);
+		}
+	MASK = static_cast<uint32_t>(bucketCount - 1);
+
+	index_metadata metadata;
+	if (!metadata.deserialize(indexMetadataFilename(baseName)))
+		exit(1);
+	hash = metadata.hash;
+	layout = metadata.layout;
+	if (!repeats.deserialize(repeatTableFilename(baseName)))
+		repeats = repeat_table();
+
+	/*
+		A write to a shard process that has died should fail (and the shard be replaced) rather than kill this process
+	*/
+	if (separateProcesses)
+		signal(SIGPIPE, SIG_IGN);
+
+	for (size_t shard = 0; shard < ranges.size(); shard++)
+		if (separateProcesses)
+			backends.push_back(std::unique_ptr<shard_backend>(new process_shard(baseName, shard, ranges[shard], metadata.layout)));
+		else
+			backends.push_back(std::unique_ptr<shard_backend>(load_local_shard(baseName, shard, ranges[shard], metadata.layout)));
+	}
+
+/*
+	SHARD_ROUTER::SHARD_OF()
+	------------------------
+*/
+size_t shard_router::shard_of(uint32_t bucket) const
+	{
+	auto found = std::upper_bound(ranges.begin(), ranges.end(), bucket, [](uint32_t value, const shard_range &range) { return value < range.last; });
+	return found - ranges.begin();
+	}
+
+/*
+	SHARD_ROUTER::LOOKUP()
+	----------------------
+	Hash each k-mer, batch the buckets by shard, query each shard (in parallel) and put the answers back in query order.
+*/
+void shard_router::lookup(const std::vector<uint64_t> &canonicalKmers, std::vector<std::vector<uint32_t>> &postings, std::vector<uint32_t> *masked)
+	{
+	std::vector<std::vector<uint32_t>> batch(ranges.size());
+	std::vector<std::vector<size_t>> slot(ranges.size());
+	std::vector<std::vector<std::vector<uint32_t>>> answer(ranges.size());
+
+	/*
+		Scatter
+	*/
+	for (size_t which = 0; which < canonicalKmers.size(); which++)
+		{
+		uint32_t bucket = kmerHash(hash, canonicalKmers[which]) & MASK;
+		size_t shard = shard_of(bucket);
+		batch[shard].push_back(bucket);
+		slot[shard].push_back(which);
+		}
+
+	std::vector<std::thread> threads;
+	std::vector<char> answered(ranges.size(), true);
+	for (size_t shard = 0; shard < ranges.size(); shard++)
+		if (!batch[shard].empty())
+			threads.push_back(std::thread([&, shard]() { answered[shard] = backends[shard]->lookup(batch[shard], answer[shard]); }));
+	for (auto &thread : threads)
+		thread.join();
+
+	/*
+		A shard that could not answer is replaced by one loaded here, which then answers its part of the batch
+	*/
+	for (size_t shard = 0; shard < ranges.size(); shard++)
+		if (!answered[shard])
+			{
+			std::cerr << "Shard " << shard << " failed, loading it into this process" << std::endl;
+			backends[shard].reset(load_local_shard(baseName, shard, ranges[shard], layout));
+			backends[shard]->lookup(batch[shard], answer[shard]);
+			}
+
+	/*
+		Gather, answering the buckets that are empty because they were moved to the repeat table from the table
+	*/
+	postings.resize(canonicalKmers.size());
+	if (masked != nullptr)
+		masked->assign(canonicalKmers.size(), 0);
+	for (size_t shard = 0; shard < ranges.size(); shard++)
+		for (size_t which = 0; which < slot[shard].size(); which++)
+			{
+			std::vector<uint32_t> &list = postings[slot[shard][which]];
+			list.swap(answer[shard][which]);
+			if (const repeat_bucket *entry = list.empty() ? repeats.find(batch[shard][which]) : nullptr)
+				{
+				list.assign(repeats.positions.begin() + entry->offset, repeats.positions.begin() + entry->offset + entry->stored);
+				if (masked != nullptr && entry->stored == 0)
+					(*masked)[slot[shard][which]] = entry->count;
+				}
+			}
+	}
@@ -0,0 +1,129 @@
+/*
+	SYNTHETICGENOME.CPP
+	-------------------
+	indexReference
+
+	Generate reproducible synthetic reference collections (as FASTA) for benchmarking.
+*/
+#include <string.h>
+
+#include <random>
+#include <vector>
+#include <algorithm>
+
+#include "syntheticGenome.hpp"
+
+static const char bases_of[] = "ACGT";
+
+/*
+	RANDOM_BASES()
+	--------------
+	Append length random bases, 32 from each 64-bit random number.  std::mt19937_64 is fully specified by the standard so
+	the output is the same everywhere (which is not true of the std::*_distribution classes, so they are not used).
+*/
+static void random_bases(std::string &into, uint64_t length, std::mt19937_64 &random)
+	{
+	while (length > 0)
+		{
+		uint64_t bits = random();
+		for (int base = 0; base < 32 && length > 0; base++, length--, bits >>= 2)
+			into += bases_of[bits & 3];
+		}
+	}
+
+/*
+	UNIFORM()
+	---------
+	A random number in [0, 1).
+*/
+static double uniform(std::mt19937_64 &random)
+	{
+	return (random() >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+/*
+	GENERATE_SYNTHETIC_GENOME()
+	---------------------------
+	The sequence is built from repeat_length blocks, each of which is either a (diverged) copy of one of the repeat families or
+	new random sequence.  Runs of N are then written over random places and the result is split into records.
+*/
+std::string generate_synthetic_genome(const synthetic_genome_parameters &parameters)
+	{
+	std::mt19937_64 random(parameters.seed);
+	uint32_t block_length = parameters.repeat_length == 0 ? 1000 : parameters.repeat_length;
+
+	/*
+		The repeat families
+	*/
+	std::vector<std::string> families(parameters.repeat_families);
+	for (auto &family : families)
+		random_bases(family, block_length, random);
+
+	/*
+		The FASTA records (worked out first so that the sequence can be allocated large enough to become the FASTA)
+	*/
+	uint32_t records = parameters.records == 0 ? 1 : parameters.records;
+	uint32_t line_length = parameters.line_length == 0 ? 80 : parameters.line_length;
+	std::vector<std::string> headers(records);
+	uint64_t fasta_size = parameters.bases;
+	for (uint32_t record = 0; record < records; record++)
+		{
+		uint64_t from = parameters.bases * record / records;
+		uint64_t to = parameters.bases * (record + 1) / records;
+		headers[record] = ">synthetic_" + std::to_string(record) + " seed=" + std::to_string(parameters.seed) + " length=" + std::to_string(to - from) + "\n";
+		fasta_size += headers[record].size() + (to - from + line_length - 1) / line_length;
+		}
+
+	/*
+		The sequence
+	*/
+	std::string sequence;
+	sequence.reserve(std::max<uint64_t>(fasta_size, parameters.bases + block_length));
+	while (sequence.size() < parameters.bases)
+		{
+		if (!families.empty() && uniform(random) < parameters.repeat_fraction)
+			{
+			size_t start = sequence.size();
+			sequence += families[random() % families.size()];
+			for (size_t pos = start; pos < sequence.size(); pos++)
+				if (uniform(random) < parameters.repeat_divergence)
+					sequence[pos] = bases_of[random() & 3];
+			}
+		else
+			random_bases(sequence, block_length, random);
+		}
+	sequence.resize(parameters.bases);
+
+	/*
+		The runs of N
+	*/
+	if (parameters.bases > parameters.n_run_length)
+		for (uint32_t run = 0; run < parameters.n_runs; run++)
+			sequence.replace(random() % (parameters.bases - parameters.n_run_length), parameters.n_run_length, parameters.n_run_length, 'N');
+
+	/*
+		Split into FASTA records.  This is done in place, so that the sequence and the FASTA are never both held: the
+		sequence is grown to the size of the FASTA (within what was reserved) and then, working back from the end (where nothing has moved yet), each line
+		is moved up to its place and followed by a newline, with each record's header written in front of its first line.
+	*/
+	std::string &fasta = sequence;
+	fasta.resize(fasta_size);
+	uint64_t end = fasta_size;
+	for (uint32_t record = records; record-- > 0; )
+		{
+		uint64_t from = parameters.bases * record / records;
+		uint64_t to = parameters.bases * (record + 1) / records;
+		uint64_t lines = (to - from + line_length - 1) / line_length;
+		for (uint64_t line = from + (lines == 0 ? 0 : (lines - 1) * line_length); lines-- > 0; line -= line_length)
+			{
+			uint64_t length = std::min<uint64_t>(line_length, to - line);
+			fasta[--end] = '\n';
+			end -= length;
+			memmove(&fasta[end], &fasta[line], length);
+			}
+		end -= headers[record].size();
+		memcpy(&fasta[end], headers[record].data(), headers[record].size());
+		}
+
+	return sequence;			// now the FASTA (returning the reference, fasta, would copy it)
+	}